@@ -51,9 +51,9 @@ void readConfig()
       showDialog(P_TitleConfigError, P_ConfigFail1, P_ConfigFail2, P_OkButtonOnly);
     } 
     else {
-      char* selector =  "Selector";
-      char* revolver =  "Revolver";
-      char* feeder   =  "Feeder";
+      const char* selector =  "Selector";
+      const char* revolver =  "Revolver";
+      const char* feeder   =  "Feeder";
       drawSDStatus(SD_READING_CONFIG);
       int toolCnt =                     root["ToolCount"];
       smuffConfig.toolCount = (toolCnt > MIN_TOOLS && toolCnt < MAX_TOOLS) ? toolCnt : 5;
@@ -63,6 +63,12 @@ void readConfig()
       smuffConfig.maxSteps_X = ((smuffConfig.toolCount-1)*smuffConfig.toolSpacing+smuffConfig.firstToolOffset) * smuffConfig.stepsPerMM_X;
       smuffConfig.maxSpeed_X =          root[selector]["MaxSpeed"];
       smuffConfig.acceleration_X =      root[selector]["Acceleration"];
+      smuffConfig.rampMode_X =          root[selector]["RampMode"];
+      smuffConfig.accelRate_X =         root[selector]["AccelRate"];
+      smuffConfig.speed_X =             root[selector]["Speed"];
+      smuffConfig.homingSpeed_X =       root[selector]["HomingSpeed"];
+      smuffConfig.homingSpeedSlow_X =   root[selector]["HomingSpeedSlow"];
+      smuffConfig.homingBump_X =        root[selector]["HomingBump"];
       smuffConfig.invertDir_X =         root[selector]["InvertDir"];
       smuffConfig.endstopTrigger_X =    root[selector]["EndstopTrigger"];
       smuffConfig.stepsPerRevolution_Y= root[revolver]["StepsPerRevolution"];
@@ -70,6 +76,13 @@ void readConfig()
       smuffConfig.revolverSpacing =     smuffConfig.stepsPerRevolution_Y / 10;
       smuffConfig.maxSpeed_Y =          root[revolver]["MaxSpeed"];
       smuffConfig.acceleration_Y =      root[revolver]["Acceleration"];
+      smuffConfig.rampMode_Y =          root[revolver]["RampMode"];
+      smuffConfig.accelRate_Y =         root[revolver]["AccelRate"];
+      smuffConfig.speed_Y =             root[revolver]["Speed"];
+      smuffConfig.homingSpeed_Y =       root[revolver]["HomingSpeed"];
+      smuffConfig.homingSpeedSlow_Y =   root[revolver]["HomingSpeedSlow"];
+      smuffConfig.homingBump_Y =        root[revolver]["HomingBump"];
+      smuffConfig.indexTolerance_Y =    root[revolver]["IndexTolerance"];
       smuffConfig.resetBeforeFeed_Y =   root[revolver]["ResetBeforeFeed"];
       smuffConfig.homeAfterFeed =       root[revolver]["HomeAfterFeed"];
       smuffConfig.invertDir_Y =         root[revolver]["InvertDir"];
@@ -77,9 +90,13 @@ void readConfig()
       smuffConfig.externalControl_Z =   root[feeder]["ExternalControl"];
       smuffConfig.stepsPerMM_Z =        root[feeder]["StepsPerMillimeter"];
       smuffConfig.acceleration_Z =      root[feeder]["Acceleration"];
+      smuffConfig.rampMode_Z =          root[feeder]["RampMode"];
+      smuffConfig.accelRate_Z =         root[feeder]["AccelRate"];
+      smuffConfig.speed_Z =             root[feeder]["Speed"];
       smuffConfig.maxSpeed_Z =          root[feeder]["MaxSpeed"];
       smuffConfig.insertSpeed_Z =       root[feeder]["InsertSpeed"];
       smuffConfig.invertDir_Z =         root[feeder]["InvertDir"];
+      smuffConfig.dedicatedTimer_Z =    root[feeder]["DedicatedTimer"];
       smuffConfig.endstopTrigger_Z =    root[feeder]["EndstopTrigger"];
       smuffConfig.reinforceLength =     root[feeder]["ReinforceLength"];
       smuffConfig.unloadRetract =       root[feeder]["UnloadRetract"];
@@ -92,6 +109,8 @@ void readConfig()
       smuffConfig.i2cAddress = (i2cAdr > 0 && i2cAdr < 255) ? i2cAdr : I2C_SLAVE_ADDRESS;
       smuffConfig.menuAutoClose =       root["MenuAutoClose"];
       smuffConfig.delayBetweenPulses =  root["DelayBetweenPulses"];
+      smuffConfig.maxInterruptRate =    root["MaxInterruptRate"];
+      smuffConfig.freeRunningTimer =    root["FreeRunningTimer"];
       smuffConfig.serial1Baudrate =     root["Serial1Baudrate"];
       smuffConfig.serial2Baudrate =     root["Serial2Baudrate"];
       smuffConfig.fanSpeed =            root["FanSpeed"];
@@ -102,6 +121,8 @@ void readConfig()
         sprintf(tmp,"Tool%d", i);
         memset(smuffConfig.materials[i], 0, sizeof(smuffConfig.materials[i]));
         strlcpy(smuffConfig.materials[i], root["Materials"][tmp], sizeof(smuffConfig.materials[i])); 
+        smuffConfig.toolTrim_X[i] =     root[selector]["Trim"][i];
+        smuffConfig.toolTrim_Y[i] =     root[revolver]["Trim"][i];
       }
       //__debug("DONE reading config");
     }
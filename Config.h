@@ -29,6 +29,9 @@
 #define FEEDER            2
 
 #define NUM_STEPPERS      3
+#define MOVE_QUEUE_SIZE   8
+#define LINE_BUFFER_SIZE  128             // received characters per serial port (power of two, max. 256)
+#define COMMAND_QUEUE_SIZE  4             // lines waiting while the parser is busy, plus one (power of two)
 
 #define MIN_TOOLS         2
 #define MAX_TOOLS         9
@@ -93,6 +96,9 @@
 #define TOOL_SPACING            21.0  // values im millimeter
 #define FIRST_REVOLVER_OFFSET   320   // values in steps
 #define REVOLVER_SPACING        320   // values im steps
+#define UNLOAD_CLEARANCE        20.0  // values in millimeter (filament tip behind the feeder endstop after unloading)
+#define UNLOAD_MARGIN           10.0  // values in millimeter (retracted beyond a known filament tip before giving up)
+#define INSERT_MARGIN           5.0   // values in millimeter (fed at insert speed at the end of a measured bowden length)
 #define USER_MESSAGE_RESET      15    // value in seconds
 #define MAX_LINES               5
 #define MAX_LINE_LENGTH         80
@@ -116,4 +122,5 @@
 #define EEPROM_TOOL_SPACING   34
 #define EEPROM_1ST_REV_OFS    38
 #define EEPROM_REV_SPACING    42
+#define EEPROM_BOWDEN_STEPS   46    // MAX_TOOLS * sizeof(long)
 #endif
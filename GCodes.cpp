@@ -1,529 +1,655 @@
-/**
- * SMuFF Firmware
- * Copyright (C) 2019 Technik Gegg
- *
- * This program is free software: you can redistribute it and/or modify
- * it under the terms of the GNU General Public License as published by
- * the Free Software Foundation, either version 3 of the License, or
- * (at your option) any later version.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU General Public License for more details.
- *
- * You should have received a copy of the GNU General Public License
- * along with this program.  If not, see <http://www.gnu.org/licenses/>.
- *
- */
-
-/*
- * Module for handling all the G-Codes supported
- */
- 
-#include "SMuFF.h"
-#include "ZTimerLib.h"
-#include "ZStepperLib.h"
-#include "GCodes.h"
-
-extern ZStepper steppers[NUM_STEPPERS];
-
-const char* S_Param = "S";
-const char* P_Param = "P";
-const char* X_Param = "X";
-const char* Y_Param = "Y";
-const char* Z_Param = "Z";
-const char* E_Param = "E";
-const char* F_Param = "F";
-const char* C_Param = "C";
-const char* T_Param = "T";
-const char* N_Param = "N";
-
-GCodeFunctions gCodeFuncsM[] = {
-  {  80, dummy },
-  {  81, dummy },
-  { 104, dummy },
-  { 105, dummy },
-  { 108, dummy },
-  { 109, dummy },
-  { 220, dummy },
-  { 221, dummy },
-
-  {  18, M18 },
-  {  20, M20 },
-  {  42, M42 },
-  {  84, M18 },
-  { 106, M106 },
-  { 107, M107 }, 
-  { 110, M110 },
-  { 111, M111 },
-  { 114, M114 },
-  { 115, M115 },
-  { 117, M117 },
-  { 119, M119 },
-  { 201, M201 },
-  { 203, M203 },
-  { 206, M206 },
-  { 250, M250 },
-  { 280, M280 },
-  { 300, M300 },
-  { 500, M500 },
-  { 503, M503 },
-  { 700, M700 },
-  { 701, M701 },
-  { 999, M999 },
-  { 2000, M2000 },
-  { 2001, M2001 },
-  { -1, NULL }
-};
-
-GCodeFunctions gCodeFuncsG[] = {
-  {   0, G0 },
-  {   1, G1 },
-  {   4, G4 },
-  {  12, G12 },
-  {  28, G28 },
-  {  90, G90 },
-  {  91, G91 },
-  { -1, NULL},
-};
-
-int param;
-extern char tmp[128];
-
-/*========================================================
- * Class G
- ========================================================*/
-bool dummy(const char* msg, String buf, int serial) {
-  int code = buf.toInt();
-  __debug("Ignored M-Code: M%d", code);
-  return true;
-}
-
-bool M18(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial); 
-  if(buf.length()==0) {
-    steppers[SELECTOR].setEnabled(false);
-    steppers[REVOLVER].setEnabled(false);
-    steppers[FEEDER].setEnabled(false);
-  }
-  else {
-    if(buf.indexOf(X_Param) != -1) {
-      steppers[SELECTOR].setEnabled(false);
-    }
-    else if(buf.indexOf(Y_Param) != -1) {
-      steppers[REVOLVER].setEnabled(false);
-    }
-    else if(buf.indexOf(Z_Param) != -1) {
-      steppers[FEEDER].setEnabled(false);
-    }
-    else {
-      stat = false;
-    }
-  }
-  return stat;
-}
-
-bool M20(const char* msg, String buf, int serial) {
-  
-  if(!getParamString(buf, S_Param, tmp, sizeof(tmp))){
-    sprintf(tmp,"/");
-  }
-  if (SD.begin(SD_SS_PIN)) {
-    File root = SD.open(tmp);
-    listDir(root, 1, serial);
-    root.close();
-    return true;
-  }
-  sprintf_P(tmp, P_SD_InitError);
-  printResponse(tmp, serial); 
-  return false;
-}
-
-bool M42(const char* msg, String buf, int serial) {
-  bool stat = true;
-  int pin;
-  printResponse(msg, serial); 
-  if((pin = getParam(buf, P_Param)) == -1) {
-    pinMode(pin, OUTPUT);
-    if((param = getParam(buf, S_Param)) == -1) {
-      if(param >= 0 && param <= 255)
-        analogWrite(pin, param);
-    }
-  }
-  return stat;
-}
-
-bool M106(const char* msg, String buf, int serial) {
-  printResponse(msg, serial); 
-  if((param = getParam(buf, S_Param)) == -1) {
-    param = 255;
-  }
-  analogWrite(FAN_PIN, param);
-  return true;
-}
- 
-bool M107(const char* msg, String buf, int serial) {
-  printResponse(msg, serial); 
-  analogWrite(FAN_PIN, 0);
-  return true;
-}
-
-bool M110(const char* msg, String buf, int serial) {
-  printResponse(msg, serial); 
-  if((param = getParam(buf, N_Param)) != -1) {
-    currentLine = param;
-  }
-  return true;
-}
-
-bool M111(const char* msg, String buf, int serial) {
-  if((param = getParam(buf, S_Param)) != -1) {
-    testMode = param == 1;
-  }      
-  return true;
-}
-
-bool M114(const char* msg, String buf, int serial) {
-  printResponse(msg, serial); 
-  sprintf_P(tmp, P_AccelSpeed, 
-  String(steppers[SELECTOR].getStepPositionMM()).c_str(),
-  String(steppers[REVOLVER].getStepPosition()).c_str(),
-  String(steppers[FEEDER].getStepPositionMM()).c_str());
-  printResponse(tmp, serial); 
-  return true;
-}
-
-bool M115(const char* msg, String buf, int serial) {
-  sprintf_P(tmp, P_GVersion, VERSION_STRING, VERSION_DATE);
-  printResponse(tmp, serial); 
-  return true;
-}
-
-bool M117(const char* msg, String buf, int serial) {
-  String umsg = buf;
-  umsg.replace("_", " ");
-  beep(1);
-  drawUserMessage(umsg);
-  return true;
-}
-
-bool M119(const char* msg, String buf, int serial) {
-  printResponse(msg, serial); 
-  if((param = getParam(buf, Z_Param)) != -1) {
-    steppers[FEEDER].setEndstopHit(param);
-  }
-  printEndstopState(serial); 
-  return true;
-}
-
-bool M201(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial); 
-  if(buf.length()==0) {
-    printAcceleration(serial);
-    return stat;
-  }
-  if((param = getParam(buf, X_Param))  != -1) {
-    if(param >= 200 && param <= 15000)
-      steppers[SELECTOR].setAcceleration(param);
-    else stat = false;
-  }
-  if((param = getParam(buf, Y_Param))  != -1) {
-    if(param >= 200 && param <= 15000)
-      steppers[REVOLVER].setAcceleration(param);
-    else stat = false;
-  }
-  if((param = getParam(buf, Z_Param))  != -1) {
-    if(param >= 200 && param <= 15000)
-      steppers[FEEDER].setAcceleration(param);
-    else stat = false;
-  }
-  return stat;
-}
-
-bool M203(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial); 
-  if(buf.length()==0) {
-    printSpeeds(serial);
-    return stat;
-  }
-  if((param = getParam(buf, X_Param))  != -1) {
-    if(param > 0 && param <= 10000)
-      steppers[SELECTOR].setMaxSpeed(param);
-    else stat = false;
-  }
-  if((param = getParam(buf, Y_Param))  != -1) {
-    if(param > 0 && param <= 10000) {
-      steppers[REVOLVER].setMaxSpeed(param);
-      //__debug("Revolver max speed: %d", steppers[REVOLVER].getMaxSpeed());
-    }
-    else stat = false;
-  }
-  if((param = getParam(buf, Z_Param))  != -1) {
-    if(param > 0 && param <= 10000)
-      steppers[FEEDER].setMaxSpeed(param);
-    else stat = false;
-  }
-  return stat;
-}
-
-bool M206(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial); 
-  if(buf.length()==0) {
-    printOffsets(serial);
-    return stat;
-  }
-  if((param = getParam(buf, X_Param))  != -1) {
-    if(param > 0 && param <= 10000)
-      smuffConfig.firstToolOffset = (float)param/10;
-    else stat = false;
-  }
-  if((param = getParam(buf, Y_Param))  != -1) {
-    if(param > 0 && param <= 8640) {
-      smuffConfig.firstRevolverOffset = param;
-    }
-    else stat = false;
-  }
-}
-
-bool M250(const char* msg, String buf, int serial) {
-  bool stat = true;
-  if((param = getParam(buf, C_Param)) != -1) {
-    if(param >= 60 && param < 256) {
-      display.setContrast(param);
-      EEPROM.put(EEPROM_CONTRAST, param);
-      printResponse(msg, serial); 
-    }
-    else
-      stat = false;
-  }
-  else {
-      printResponse(msg, serial);
-      char tmp[50];
-      sprintf_P(tmp, P_M250Response, smuffConfig.lcdContrast);
-      printResponse(tmp, serial); 
-  }
-  return stat;
-}
-
-bool M280(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial);
-  if((param = getParam(buf, S_Param)) != -1) {
-    if(!setServoPos(param))
-      stat = false;
-  }
-  else stat = false;
-  return stat;
-}
-
-bool M300(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial);
-  if((param = getParam(buf, S_Param)) != -1) {
-    int frequency = param;
-    if((param = getParam(buf, P_Param)) != -1) {
-      tone(BEEPER_PIN, frequency, param);
-    }
-    else 
-      stat = false;
-  }
-  else 
-    stat = false;
-  return stat;
-}
-
-bool M500(const char* msg, String buf, int serial) {
-  printResponse(msg, serial);
-  saveSettings(serial);
-  return true;
-}
-
-bool M503(const char* msg, String buf, int serial) {
-  printResponse(msg, serial);
-  reportSettings(serial);
-  return true;
-}
-
-bool M700(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial);
-  if(toolSelected > 0 && toolSelected <= MAX_TOOLS) {
-    getParamString(buf, S_Param, smuffConfig.materials[toolSelected], sizeof(smuffConfig.materials[0]));
-    //__debug("Material: %s\n",smuffConfig.materials[toolSelected]);
-    return loadFilament();
-  }
-  else 
-    stat = false;
-  return stat;
-}
-
-bool M701(const char* msg, String buf, int serial) {
-  printResponse(msg, serial);
-  return unloadFilament();
-}
-
-bool M999(const char* msg, String buf, int serial) {
-  printResponse(msg, serial); 
-  delay(500); 
-  __asm__ volatile ("jmp 0x0000"); 
-  return true;
-}
-
-bool M2000(const char* msg, String buf, int serial) {
-  char s[80];
-  printResponse(msg, serial); 
-  getParamString(buf, S_Param, tmp, sizeof(tmp));
-  if(strlen(tmp)>0) {
-    printResponse("B", serial);
-    for(int i=0; i< strlen(tmp); i++) {
-      sprintf(s,"%d:", (char)tmp[i]);
-      printResponse(s, serial); 
-    }
-    printResponse("10\n", serial);
-  }
-  return true;
-}
-
-bool M2001(const char* msg, String buf, int serial) {
-  printResponse(msg, serial); 
-  getParamString(buf, S_Param, tmp, sizeof(tmp));
-  String data = String(tmp);
-  data.trim();
-  if(data.length() > 0) {
-    int ndx = 0;
-    int pos = 0;
-    if(data.startsWith("B")) {
-      printResponse(">>", serial); 
-      ndx++;
-      do {
-        pos = data.indexOf(":", ndx);
-        int c;
-        if(pos != -1) {
-          c = data.substring(ndx, pos).toInt();
-        }
-        else {
-          c = data.substring(ndx).toInt();
-        }
-        if(c == 10) {
-          printResponse("\\n", serial); 
-        }
-        else {
-          sprintf(tmp, "%c", c);
-          printResponse(tmp, serial); 
-        }
-        ndx = pos + 1;
-      } while(pos != -1);
-      printResponse("<<\n", serial); 
-    }
-    else {
-      printResponseP(P_WrongFormat, serial);
-      return false;
-    }
-  }
-  else 
-    return false;
-  return true;
-}
-
-/*========================================================
- * Class G
- ========================================================*/
-bool G0(const char* msg, String buf, int serial) {
-  printResponse(msg, serial);
-  if((param = getParam(buf, Y_Param)) != -1) {
-    steppers[REVOLVER].setEnabled(true);
-    prepSteppingAbs(REVOLVER, smuffConfig.firstRevolverOffset + ((param)*smuffConfig.revolverSpacing), true);
-    runAndWait(REVOLVER);
-  }
-  if((param = getParam(buf, X_Param)) != -1) {
-    steppers[SELECTOR].setEnabled(true);
-    prepSteppingAbsMillimeter(SELECTOR, smuffConfig.firstToolOffset + (param * smuffConfig.toolSpacing));
-    runAndWait(SELECTOR);
-  }
-  return true;
-}
-
-bool G1(const char* msg, String buf, int serial) {
-  printResponse(msg, serial);
-  bool isMill = true;
-  if((param = getParam(buf, T_Param)) != -1) {
-    isMill = (param == 1);
-  }
-  if((param = getParam(buf, Y_Param)) != -1) {
-    //__debug("G1 moving Y: %d", param);
-    steppers[REVOLVER].setEnabled(true);
-    prepStepping(REVOLVER, (long)param, isMill);
-  }
-  if((param = getParam(buf, X_Param)) != -1) {
-    //__debug("G1 moving X: %d", param);
-    steppers[SELECTOR].setEnabled(true);
-    prepStepping(SELECTOR, (long)param, isMill, true);
-  }
-  if((param = getParam(buf, Z_Param)) != -1) {
-    //__debug("G1 moving Z: %d", param);
-    steppers[FEEDER].setEnabled(true);
-    prepStepping(FEEDER, (long)param, isMill);
-  }
-  runAndWait(-1);
-  return true;
-}
-
-bool G4(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial);
-  if((param = getParam(buf, S_Param)) != -1) {
-    if(param > 0 && param < 500)
-      delay(param*1000);
-  }
-  else if((param = getParam(buf, P_Param)) != -1) {
-      delay(param);
-  }
-  else {
-    stat = false;
-  }
-  return stat;
-}
-
-bool G12(const char* msg, String buf, int serial) {
-  printResponse(msg, serial);
-  setServoPos(180);
-  delay(500);
-  setServoPos(0);
-  return true;
-}
-
-bool G28(const char* msg, String buf, int serial) {
-  bool stat = true;
-  printResponse(msg, serial);
-  if(buf.length()==0) {
-    stat = moveHome(SELECTOR, false, true); 
-    if(stat)
-      moveHome(REVOLVER, false, false); 
-  }
-  else {
-    if(buf.indexOf(X_Param) != -1) {
-      stat = moveHome(SELECTOR, false, false); 
-    }
-    if(buf.indexOf(Y_Param) != -1) {
-      stat = moveHome(REVOLVER, false, false); 
-    }
-  }
-  return stat;
-}
-
-bool G90(const char* msg, String buf, int serial) {
-  printResponse(msg, serial);
-  positionMode = ABSOLUTE;
-  return true;
-}
-
-bool G91(const char* msg, String buf, int serial) {
-  printResponse(msg, serial);
-  positionMode = RELATIVE;
-  return true;
+/**
+ * SMuFF Firmware
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Module for handling all the G-Codes supported
+ */
+ 
+#include "SMuFF.h"
+#include "ZTimerLib.h"
+#include "ZStepperLib.h"
+#include "GCodes.h"
+#include "ZLineBuffer.h"
+#include "ZCommandQueue.h"
+
+extern ZStepper steppers[NUM_STEPPERS];
+extern ZTimer   stepperTimer;
+extern ZLineBuffer lineBuffer0, lineBuffer2, lineBuffer9;
+extern ZCommandQueue commandQueue;
+
+const char S_Param = 'S';
+const char P_Param = 'P';
+const char X_Param = 'X';
+const char Y_Param = 'Y';
+const char Z_Param = 'Z';
+const char E_Param = 'E';
+const char F_Param = 'F';
+const char C_Param = 'C';
+const char T_Param = 'T';
+const char N_Param = 'N';
+
+// searched binary by parse_M() and parse_G(), so both tables have to be sorted by code
+constexpr GCodeFunctions gCodeFuncsM[] PROGMEM = {
+  {   18, M18 },
+  {   20, M20 },
+  {   42, M42 },
+  {   80, dummy },
+  {   81, dummy },
+  {   84, M18 },
+  {  104, dummy },
+  {  105, dummy },
+  {  106, M106 },
+  {  107, M107 },
+  {  108, dummy },
+  {  109, dummy },
+  {  110, M110 },
+  {  111, M111 },
+  {  114, M114 },
+  {  115, M115 },
+  {  117, M117 },
+  {  119, M119 },
+  {  122, M122 },
+  {  201, M201 },
+  {  203, M203 },
+  {  206, M206 },
+  {  220, dummy },
+  {  221, dummy },
+  {  250, M250 },
+  {  280, M280 },
+  {  300, M300 },
+  {  400, M400 },
+  {  500, M500 },
+  {  503, M503 },
+  {  700, M700 },
+  {  701, M701 },
+  {  705, M705 },
+  {  999, M999 },
+  { 2000, M2000 },
+  { 2001, M2001 },
+  { 2002, M2002 },
+};
+
+constexpr GCodeFunctions gCodeFuncsG[] PROGMEM = {
+  {   0, G0 },
+  {   1, G1 },
+  {   4, G4 },
+  {  12, G12 },
+  {  28, G28 },
+  {  90, G90 },
+  {  91, G91 },
+};
+
+const int gCodeFuncsMCount = sizeof(gCodeFuncsM) / sizeof(gCodeFuncsM[0]);
+const int gCodeFuncsGCount = sizeof(gCodeFuncsG) / sizeof(gCodeFuncsG[0]);
+
+static_assert(isSortedByCode(gCodeFuncsM, gCodeFuncsMCount), "gCodeFuncsM[] must be sorted by code");
+static_assert(isSortedByCode(gCodeFuncsG, gCodeFuncsGCount), "gCodeFuncsG[] must be sorted by code");
+
+int param;
+extern char tmp[128];
+
+/*========================================================
+ * Class G
+ ========================================================*/
+bool dummy(const char* msg, GCodeParams* params, int serial) {
+  __debug("Ignored M-Code: %s", msg);
+  return true;
+}
+
+bool M18(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial); 
+  if(params->present == 0) {
+    steppers[SELECTOR].setEnabled(false);
+    steppers[REVOLVER].setEnabled(false);
+    steppers[FEEDER].setEnabled(false);
+  }
+  else {
+    if(hasParam(params, X_Param)) {
+      steppers[SELECTOR].setEnabled(false);
+    }
+    else if(hasParam(params, Y_Param)) {
+      steppers[REVOLVER].setEnabled(false);
+    }
+    else if(hasParam(params, Z_Param)) {
+      steppers[FEEDER].setEnabled(false);
+    }
+    else {
+      stat = false;
+    }
+  }
+  return stat;
+}
+
+bool M20(const char* msg, GCodeParams* params, int serial) {
+  
+  if(!getParamString(params, S_Param, tmp, sizeof(tmp))){
+    sprintf(tmp,"/");
+  }
+  if (SD.begin(SD_SS_PIN)) {
+    File root = SD.open(tmp);
+    listDir(root, 1, serial);
+    root.close();
+    return true;
+  }
+  sprintf_P(tmp, P_SD_InitError);
+  printResponse(tmp, serial); 
+  return false;
+}
+
+bool M42(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  int pin;
+  printResponse(msg, serial); 
+  if(getParam(params, P_Param, &pin)) {
+    pinMode(pin, OUTPUT);
+    if(getParam(params, S_Param, &param)) {
+      if(param >= 0 && param <= 255)
+        analogWrite(pin, param);
+    }
+  }
+  return stat;
+}
+
+bool M106(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  if(!getParam(params, S_Param, &param)) {
+    param = 255;
+  }
+  analogWrite(FAN_PIN, param);
+  return true;
+}
+ 
+bool M107(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  analogWrite(FAN_PIN, 0);
+  return true;
+}
+
+bool M110(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  if(getParam(params, N_Param, &param)) {
+    currentLine = param;
+  }
+  return true;
+}
+
+bool M111(const char* msg, GCodeParams* params, int serial) {
+  if(getParam(params, S_Param, &param)) {
+    testMode = param == 1;
+  }      
+  return true;
+}
+
+bool M114(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  sprintf_P(tmp, P_AccelSpeed, 
+  String(steppers[SELECTOR].getStepPositionMM()).c_str(),
+  String(steppers[REVOLVER].getStepPosition()).c_str(),
+  String(steppers[FEEDER].getStepPositionMM()).c_str());
+  printResponse(tmp, serial); 
+  return true;
+}
+
+bool M115(const char* msg, GCodeParams* params, int serial) {
+  sprintf_P(tmp, P_GVersion, VERSION_STRING, VERSION_DATE);
+  printResponse(tmp, serial); 
+  return true;
+}
+
+bool M117(const char* msg, GCodeParams* params, int serial) {
+  String umsg = params->text;
+  umsg.replace("_", " ");
+  beep(1);
+  drawUserMessage(umsg);
+  return true;
+}
+
+bool M119(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  if(getParam(params, Z_Param, &param)) {
+    steppers[FEEDER].setEndstopHit(param);
+  }
+  printEndstopState(serial); 
+  return true;
+}
+
+bool M122(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  if(getParam(params, S_Param, &param)) {
+    stepperTimer.setMeasurement(param == 1);
+  }
+  sprintf_P(tmp, P_TimerDiag,
+          stepperTimer.isFreeRunning() ? "free-running" : "CTC",
+          stepperTimer.getMeasurement() ? "on" : "off",
+          stepperTimer.getSamples(),
+          stepperTimer.getDeviationMin(),
+          stepperTimer.getDeviationAvg(),
+          stepperTimer.getDeviationMax(),
+          stepperTimer.getMissedDeadlines());
+  printResponse(tmp, serial);
+  printResponseP(P_HomingTime, serial);
+  sprintf_P(tmp, P_AccelSpeed,
+          String(steppers[SELECTOR].getHomingTime()).c_str(),
+          String(steppers[REVOLVER].getHomingTime()).c_str(),
+          "--");
+  printResponse(tmp, serial);
+  sprintf_P(tmp, P_IndexDrift, steppers[REVOLVER].getIndexDrift(), steppers[REVOLVER].isPositionValid() ? "valid" : "needs homing");
+  printResponse(tmp, serial);
+  sprintf_P(tmp, P_ToolChangeTime, toolChangeTime);
+  printResponse(tmp, serial);
+  sprintf_P(tmp, P_LineStats, 0, lineBuffer0.getLinesReceived(), lineBuffer0.getOverflows());
+  printResponse(tmp, serial);
+  sprintf_P(tmp, P_LineStats, 2, lineBuffer2.getLinesReceived(), lineBuffer2.getOverflows());
+  printResponse(tmp, serial);
+  sprintf_P(tmp, P_LineStats, 9, lineBuffer9.getLinesReceived(), lineBuffer9.getOverflows());
+  printResponse(tmp, serial);
+  sprintf_P(tmp, P_CommandQueue, commandQueue.getCount(), commandQueue.getCapacity(), commandQueue.getMaxCount());
+  printResponse(tmp, serial);
+  return true;
+}
+
+bool M201(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial); 
+  if(params->present == 0) {
+    printAcceleration(serial);
+    return stat;
+  }
+  // ramp mode (S0 = linear, S1 = trapezoid, S2 = S-curve, S3 = AVR446) of
+  // the axes given, if not set the configured mode stays
+  int mode = -1;
+  if(getParam(params, S_Param, &mode) && (mode < ZStepper::LINEAR || mode > ZStepper::AVR446))
+    return false;
+  waitForMoveQueue();
+  // mm/s^2 on Selector and Feeder, degrees/s^2 on the Revolver
+  float rate;
+  for(int i = 0; i < NUM_STEPPERS; i++) {
+    if(!getParam(params, i == SELECTOR ? X_Param : (i == REVOLVER ? Y_Param : Z_Param), &rate))
+      continue;
+    if(rate > 0 && rate <= 30000) {
+      if(mode != -1)
+        steppers[i].setRampMode((ZStepper::RampMode)mode);
+      setAccelerationRate(i, rate);
+    }
+    else stat = false;
+  }
+  return stat;
+}
+
+bool M203(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial); 
+  if(params->present == 0) {
+    printSpeeds(serial);
+    return stat;
+  }
+  waitForMoveQueue();
+  // mm/s on Selector and Feeder, degrees/s on the Revolver; speeds the
+  // interrupt can't step at (see MaxInterruptRate) are rejected
+  float speed;
+  for(int i = 0; i < NUM_STEPPERS; i++) {
+    if(!getParam(params, i == SELECTOR ? X_Param : (i == REVOLVER ? Y_Param : Z_Param), &speed))
+      continue;
+    if(speed > 0 && speed * getStepsPerUnit(i) <= steppers[i].getStepRateLimit())
+      setSpeedRate(i, speed);
+    else stat = false;
+  }
+  return stat;
+}
+
+bool M206(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial); 
+  if(params->present == 0) {
+    printOffsets(serial);
+    return stat;
+  }
+  if(getParam(params, T_Param, &param)) {
+    // per tool trims, X in 1/10 mm, Y in steps (may be negative)
+    int tool = param;
+    if(tool < 0 || tool >= smuffConfig.toolCount)
+      return false;
+    if(getParam(params, X_Param, &param)) {
+      if(param >= -100 && param <= 100)
+        smuffConfig.toolTrim_X[tool] = (float)param/10;
+      else stat = false;
+    }
+    if(getParam(params, Y_Param, &param)) {
+      if(abs(param) <= smuffConfig.revolverSpacing/2)
+        smuffConfig.toolTrim_Y[tool] = param;
+      else stat = false;
+    }
+    buildToolPositions();
+    return stat;
+  }
+  if(getParam(params, X_Param, &param)) {
+    if(param > 0 && param <= 10000)
+      smuffConfig.firstToolOffset = (float)param/10;
+    else stat = false;
+  }
+  if(getParam(params, Y_Param, &param)) {
+    if(param > 0 && param <= 8640) {
+      smuffConfig.firstRevolverOffset = param;
+    }
+    else stat = false;
+  }
+  buildToolPositions();
+  return stat;
+}
+
+bool M250(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  if(getParam(params, C_Param, &param)) {
+    if(param >= 60 && param < 256) {
+      display.setContrast(param);
+      EEPROM.put(EEPROM_CONTRAST, param);
+      printResponse(msg, serial); 
+    }
+    else
+      stat = false;
+  }
+  else {
+      printResponse(msg, serial);
+      char tmp[50];
+      sprintf_P(tmp, P_M250Response, smuffConfig.lcdContrast);
+      printResponse(tmp, serial); 
+  }
+  return stat;
+}
+
+bool M280(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial);
+  if(getParam(params, S_Param, &param)) {
+    if(!setServoPos(param))
+      stat = false;
+  }
+  else stat = false;
+  return stat;
+}
+
+bool M300(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial);
+  if(getParam(params, S_Param, &param)) {
+    int frequency = param;
+    if(getParam(params, P_Param, &param)) {
+      tone(BEEPER_PIN, frequency, param);
+    }
+    else 
+      stat = false;
+  }
+  else 
+    stat = false;
+  return stat;
+}
+
+bool M400(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  waitForMoveQueue();
+  return true;
+}
+
+bool M500(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  saveSettings(serial);
+  return true;
+}
+
+bool M503(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  reportSettings(serial);
+  return true;
+}
+
+bool M700(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial);
+  if(toolSelected > 0 && toolSelected <= MAX_TOOLS) {
+    getParamString(params, S_Param, smuffConfig.materials[toolSelected], sizeof(smuffConfig.materials[0]));
+    //__debug("Material: %s\n",smuffConfig.materials[toolSelected]);
+    return loadFilament();
+  }
+  else 
+    stat = false;
+  return stat;
+}
+
+bool M701(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  return unloadFilament();
+}
+
+/*
+ * M705         report the bowden length of all tools
+ * M705 S1      take the current filament tip as load point of the selected tool
+ * M705 Tn Zmm  set the bowden length of tool n (Z0 = back to default)
+ */
+bool M705(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  int tool = toolSelected;
+  float length;
+  printResponse(msg, serial);
+  if(getParam(params, T_Param, &param)) {
+    tool = param;
+  }
+  if(tool < 0 || tool >= smuffConfig.toolCount) {
+    stat = false;
+  }
+  else if(getParam(params, S_Param, &param)) {
+    if(param == 1 && tool == toolSelected && steppers[FEEDER].isPositionValid() && steppers[FEEDER].getStepPosition() > 0)
+      setBowdenSteps(tool, steppers[FEEDER].getStepPosition());
+    else stat = false;
+  }
+  else if(getParam(params, Z_Param, &length)) {
+    if(length >= 0 && length <= 5000)
+      setBowdenSteps(tool, (long)(length * steppers[FEEDER].getStepsPerMM()));
+    else stat = false;
+  }
+  else
+    printBowdenLengths(serial);
+  return stat;
+}
+
+bool M999(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  delay(500); 
+  __asm__ volatile ("jmp 0x0000"); 
+  return true;
+}
+
+bool M2000(const char* msg, GCodeParams* params, int serial) {
+  char s[80];
+  printResponse(msg, serial); 
+  getParamString(params, S_Param, tmp, sizeof(tmp));
+  if(strlen(tmp)>0) {
+    printResponse("B", serial);
+    for(int i=0; i< strlen(tmp); i++) {
+      sprintf(s,"%d:", (char)tmp[i]);
+      printResponse(s, serial); 
+    }
+    printResponse("10\n", serial);
+  }
+  return true;
+}
+
+bool M2001(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  getParamString(params, S_Param, tmp, sizeof(tmp));
+  String data = String(tmp);
+  data.trim();
+  if(data.length() > 0) {
+    int ndx = 0;
+    int pos = 0;
+    if(data.startsWith("B")) {
+      printResponse(">>", serial); 
+      ndx++;
+      do {
+        pos = data.indexOf(":", ndx);
+        int c;
+        if(pos != -1) {
+          c = data.substring(ndx, pos).toInt();
+        }
+        else {
+          c = data.substring(ndx).toInt();
+        }
+        if(c == 10) {
+          printResponse("\\n", serial); 
+        }
+        else {
+          sprintf(tmp, "%c", c);
+          printResponse(tmp, serial); 
+        }
+        ndx = pos + 1;
+      } while(pos != -1);
+      printResponse("<<\n", serial); 
+    }
+    else {
+      printResponseP(P_WrongFormat, serial);
+      return false;
+    }
+  }
+  else 
+    return false;
+  return true;
+}
+
+bool M2002(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial); 
+  noInterrupts();
+  IsrProfile profile = *(IsrProfile*)&isrProfile;
+  unsigned long missed = stepperTimer.getMissedDeadlines();
+  interrupts();
+  sprintf_P(tmp, P_IsrProfile,
+          profile.min,
+          profile.count > 0 ? (unsigned int)(profile.sum / profile.count) : 0,
+          profile.max,
+          profile.count,
+          profile.stepperMax,
+          missed);
+  printResponse(tmp, serial);
+  sprintf_P(tmp, P_AccelSpeed,
+          String(steppers[SELECTOR].getPeakStepRate()).c_str(),
+          String(steppers[REVOLVER].getPeakStepRate()).c_str(),
+          String(steppers[FEEDER].getPeakStepRate()).c_str());
+  printResponse(tmp, serial);
+  resetIsrProfile();
+  return true;
+}
+
+/*========================================================
+ * Class G
+ ========================================================*/
+bool G0(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  if(getParam(params, Y_Param, &param)) {
+    steppers[REVOLVER].setEnabled(true);
+    prepSteppingAbs(REVOLVER, getToolPosition(REVOLVER, param), true);
+    runAndWait(REVOLVER);
+  }
+  if(getParam(params, X_Param, &param)) {
+    steppers[SELECTOR].setEnabled(true);
+    prepSteppingAbs(SELECTOR, getToolPosition(SELECTOR, param));
+    runAndWait(SELECTOR);
+  }
+  return true;
+}
+
+bool G1(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  bool isMill = true;
+  float distance;
+  if(getParam(params, T_Param, &param)) {
+    isMill = (param == 1);
+  }
+  if(getParam(params, Y_Param, &distance)) {
+    //__debug("G1 moving Y: %s", String(distance).c_str());
+    steppers[REVOLVER].setEnabled(true);
+    prepStepping(REVOLVER, distance, isMill);
+  }
+  if(getParam(params, X_Param, &distance)) {
+    //__debug("G1 moving X: %s", String(distance).c_str());
+    steppers[SELECTOR].setEnabled(true);
+    prepStepping(SELECTOR, distance, isMill, true);
+  }
+  if(getParam(params, Z_Param, &distance)) {
+    //__debug("G1 moving Z: %s", String(distance).c_str());
+    steppers[FEEDER].setEnabled(true);
+    // the feeder endstop is the origin of the filament tip, not a travel limit
+    prepStepping(FEEDER, distance, isMill, true);
+  }
+  runNoWait(-1);
+  return true;
+}
+
+bool G4(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial);
+  if(getParam(params, S_Param, &param)) {
+    if(param > 0 && param < 500)
+      delay(param*1000);
+  }
+  else if(getParam(params, P_Param, &param)) {
+      delay(param);
+  }
+  else {
+    stat = false;
+  }
+  return stat;
+}
+
+bool G12(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  setServoPos(180);
+  delay(500);
+  setServoPos(0);
+  return true;
+}
+
+bool G28(const char* msg, GCodeParams* params, int serial) {
+  bool stat = true;
+  printResponse(msg, serial);
+  if(params->present == 0) {
+    stat = moveHome(SELECTOR, false, true); 
+    if(stat)
+      moveHome(REVOLVER, false, false); 
+  }
+  else {
+    if(hasParam(params, X_Param)) {
+      stat = moveHome(SELECTOR, false, false); 
+    }
+    if(hasParam(params, Y_Param)) {
+      stat = moveHome(REVOLVER, false, false); 
+    }
+  }
+  return stat;
+}
+
+bool G90(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  positionMode = ABSOLUTE;
+  return true;
+}
+
+bool G91(const char* msg, GCodeParams* params, int serial) {
+  printResponse(msg, serial);
+  positionMode = RELATIVE;
+  return true;
 }
@@ -23,45 +23,88 @@
 #include <stdlib.h>
 #include <Arduino.h>
 
+#define MAX_GCODE_LENGTH  80              // longest line accepted by the parser
+#define PARAM_MASK(letter)  (1UL << ((letter) - 'A'))
+
+/*
+ * Parameters of a command, parsed once; text refers to the line buffer.
+ */
+typedef struct {
+  uint32_t    present;                    // PARAM_MASK(letter) for each parameter given
+  float       value[26];                  // numeric value of each parameter given
+  const char* text;                       // parameter section as received (for quoted strings)
+} GCodeParams;
+
+typedef bool (*GCodeFunc)(const char* msg, GCodeParams* params, int serial);
+
 typedef struct {
   int code;
-  bool (*func)(const char* msg, String buf, int serial);
+  GCodeFunc func;
 } GCodeFunctions;
 
+/*
+ * Compile time check for the dispatch tables, which are searched binary.
+ */
+constexpr bool isSortedByCode(const GCodeFunctions* table, int count) {
+  return count < 2 || (table[0].code < table[1].code && isSortedByCode(table + 1, count - 1));
+}
+
+/*
+ * A tokenized line.
+ */
+typedef struct {
+  char        cmd;                        // command letter ('G', 'M', 'T'), 0 for empty lines
+  int         code;                       // command number
+  bool        hasCode;                    // false if the command letter isn't followed by a number
+  long        lineNumber;                 // value of the N word, -1 if missing
+  GCodeParams params;
+} GCodeLine;
+
+extern bool tokenizeGcode(char* line, GCodeLine* gcode);
+extern GCodeFunc findGCodeFunc(const GCodeFunctions* table, int count, int code);
+extern bool hasParam(GCodeParams* params, char letter);
+extern bool getParam(GCodeParams* params, char letter, int* value);
+extern bool getParam(GCodeParams* params, char letter, float* value);
+extern bool getParamString(GCodeParams* params, char letter, char* dest, int bufLen);
+
 extern unsigned int currentLine;
 
-extern bool dummy(const char* msg, String buf, int serial);
-extern bool M18(const char* msg, String buf, int serial);
-extern bool M20(const char* msg, String buf, int serial);
-extern bool M42(const char* msg, String buf, int serial);
-extern bool M106(const char* msg, String buf, int serial);
-extern bool M107(const char* msg, String buf, int serial);
-extern bool M110(const char* msg, String buf, int serial);
-extern bool M111(const char* msg, String buf, int serial);
-extern bool M114(const char* msg, String buf, int serial);
-extern bool M115(const char* msg, String buf, int serial);
-extern bool M117(const char* msg, String buf, int serial);
-extern bool M119(const char* msg, String buf, int serial);
-extern bool M201(const char* msg, String buf, int serial);
-extern bool M203(const char* msg, String buf, int serial);
-extern bool M206(const char* msg, String buf, int serial);
-extern bool M250(const char* msg, String buf, int serial);
-extern bool M280(const char* msg, String buf, int serial);
-extern bool M300(const char* msg, String buf, int serial);
-extern bool M500(const char* msg, String buf, int serial);
-extern bool M503(const char* msg, String buf, int serial);
-extern bool M700(const char* msg, String buf, int serial);
-extern bool M701(const char* msg, String buf, int serial);
-extern bool M999(const char* msg, String buf, int serial);
-extern bool M2000(const char* msg, String buf, int serial);
-extern bool M2001(const char* msg, String buf, int serial);
+extern bool dummy(const char* msg, GCodeParams* params, int serial);
+extern bool M18(const char* msg, GCodeParams* params, int serial);
+extern bool M20(const char* msg, GCodeParams* params, int serial);
+extern bool M42(const char* msg, GCodeParams* params, int serial);
+extern bool M106(const char* msg, GCodeParams* params, int serial);
+extern bool M107(const char* msg, GCodeParams* params, int serial);
+extern bool M110(const char* msg, GCodeParams* params, int serial);
+extern bool M111(const char* msg, GCodeParams* params, int serial);
+extern bool M114(const char* msg, GCodeParams* params, int serial);
+extern bool M115(const char* msg, GCodeParams* params, int serial);
+extern bool M117(const char* msg, GCodeParams* params, int serial);
+extern bool M119(const char* msg, GCodeParams* params, int serial);
+extern bool M122(const char* msg, GCodeParams* params, int serial);
+extern bool M201(const char* msg, GCodeParams* params, int serial);
+extern bool M203(const char* msg, GCodeParams* params, int serial);
+extern bool M206(const char* msg, GCodeParams* params, int serial);
+extern bool M250(const char* msg, GCodeParams* params, int serial);
+extern bool M280(const char* msg, GCodeParams* params, int serial);
+extern bool M300(const char* msg, GCodeParams* params, int serial);
+extern bool M400(const char* msg, GCodeParams* params, int serial);
+extern bool M500(const char* msg, GCodeParams* params, int serial);
+extern bool M503(const char* msg, GCodeParams* params, int serial);
+extern bool M700(const char* msg, GCodeParams* params, int serial);
+extern bool M701(const char* msg, GCodeParams* params, int serial);
+extern bool M705(const char* msg, GCodeParams* params, int serial);
+extern bool M999(const char* msg, GCodeParams* params, int serial);
+extern bool M2000(const char* msg, GCodeParams* params, int serial);
+extern bool M2001(const char* msg, GCodeParams* params, int serial);
+extern bool M2002(const char* msg, GCodeParams* params, int serial);
 
-extern bool G0(const char* msg, String buf, int serial);
-extern bool G1(const char* msg, String buf, int serial);
-extern bool G4(const char* msg, String buf, int serial);
-extern bool G12(const char* msg, String buf, int serial);
-extern bool G28(const char* msg, String buf, int serial);
-extern bool G90(const char* msg, String buf, int serial);
-extern bool G91(const char* msg, String buf, int serial);
+extern bool G0(const char* msg, GCodeParams* params, int serial);
+extern bool G1(const char* msg, GCodeParams* params, int serial);
+extern bool G4(const char* msg, GCodeParams* params, int serial);
+extern bool G12(const char* msg, GCodeParams* params, int serial);
+extern bool G28(const char* msg, GCodeParams* params, int serial);
+extern bool G90(const char* msg, GCodeParams* params, int serial);
+extern bool G91(const char* msg, GCodeParams* params, int serial);
 
 #endif
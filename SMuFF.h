@@ -52,23 +52,42 @@ typedef struct {
   long  maxSteps_X          = 68000;
   int   maxSpeed_X          = 10;
   int   acceleration_X      = 510;
+  int   rampMode_X          = 0;
+  float accelRate_X         = 0;
+  float speed_X             = 0;
+  float homingSpeed_X       = 0;
+  float homingSpeedSlow_X   = 0;
+  float homingBump_X        = 0;
   bool  invertDir_X         = false;
   int   endstopTrigger_X    = HIGH;
+  float toolTrim_X[MAX_TOOLS];          // per tool correction of the selector position (mm)
   
   long  stepsPerRevolution_Y= 9600;
   long  maxSteps_Y          = 9600;
   int   maxSpeed_Y          = 800;
   int   acceleration_Y      = 2000;
+  int   rampMode_Y          = 0;
+  float accelRate_Y         = 0;
+  float speed_Y             = 0;
+  float homingSpeed_Y       = 0;
+  float homingSpeedSlow_Y   = 0;
+  float homingBump_Y        = 0;
+  float indexTolerance_Y    = 0;
   bool  resetBeforeFeed_Y   = true;
   bool  invertDir_Y         = false;
   int   endstopTrigger_Y    = HIGH;
+  int   toolTrim_Y[MAX_TOOLS];          // per tool correction of the revolver position (steps)
   
   bool  externalControl_Z   = false;
   long  stepsPerMM_Z        = Z_STEPS_PER_MM;
   int   maxSpeed_Z          = 10;
   int   insertSpeed_Z       = 1000;
   int   acceleration_Z      = 300;
+  int   rampMode_Z          = 0;
+  float accelRate_Z         = 0;
+  float speed_Z             = 0;
   bool  invertDir_Z         = false;
+  bool  dedicatedTimer_Z    = false;
   int   endstopTrigger_Z    = LOW;
   
   float unloadRetract       = -20.0f;
@@ -81,28 +100,42 @@ typedef struct {
   int   lcdContrast         = DSP_CONTRAST;
   int   menuAutoClose       = 20;
   bool  delayBetweenPulses  = false;
+  unsigned long maxInterruptRate = 0;
+  bool  freeRunningTimer    = false;
   unsigned long serial1Baudrate = 9600;
   unsigned long serial2Baudrate = 9600;
   int   fanSpeed            = 0;
-  volatile char materials[MAX_TOOLS][20];
+  char  materials[MAX_TOOLS][20];
   int powerSaveTimeout      = 15;
 } SMuFFConfig;
 
+typedef struct {
+  unsigned long count;                // number of interrupts profiled
+  unsigned long sum;                  // total cycles of all interrupts
+  unsigned int  min;                  // cycles of the shortest interrupt
+  unsigned int  max;                  // cycles of the longest interrupt
+  unsigned int  stepperMax;           // cycles of the longest ZStepper::handleISR() call
+} IsrProfile;
+
 extern U8G2_ST7565_64128N_F_4W_HW_SPI   display;
 extern Encoder                          encoder;
 
 extern SMuFFConfig    smuffConfig;
-extern GCodeFunctions gCodeFuncsM[];
-extern GCodeFunctions gCodeFuncsG[];
+extern const GCodeFunctions gCodeFuncsM[];
+extern const GCodeFunctions gCodeFuncsG[];
+extern const int      gCodeFuncsMCount;
+extern const int      gCodeFuncsGCount;
 
 extern const char     brand[];
 extern volatile byte  nextStepperFlag;
 extern volatile byte  remainingSteppersFlag;
+extern volatile IsrProfile isrProfile;
 extern volatile unsigned long lastEncoderButtonTime;
 extern char           buf[];
 extern byte           toolSelected;
+extern unsigned long  toolChangeTime;
 extern PositionMode   positionMode;
-extern String         serialBuffer0, serialBuffer2, serialBuffer3, serialBuffer9, traceSerial2; 
+extern char           traceSerial2[]; 
 extern bool           displayingUserMessage;
 extern unsigned int   userMessageTime;
 extern bool           testMode;
@@ -125,18 +158,25 @@ extern bool showFeederFailedMessage(int state);
 extern int  showDialog(PGM_P title, PGM_P message, PGM_P addMessage, PGM_P buttons);
 extern bool moveHome(int index, bool showMessage=true, bool checkFeeder=true);
 extern bool loadFilament(bool showMessage=true);
-extern bool unloadFilament();
+extern bool unloadFilament(bool pipelined=false);
+extern void finishUnload();
 extern void runAndWait(int index);
 extern void runNoWait(int index);
+extern bool isMoveQueueIdle();
+extern void resetIsrProfile();
+extern void waitForMoveQueue();
+extern long getPlannedPosition(int index);
+extern void addQueuedMove(int index, long steps, bool ignoreEndstop);
+extern void queueMove();
+extern void queueMoveAfter(byte waitFlags);
 extern bool selectTool(int ndx, bool showMessage = true);
 extern void setStepperSteps(int index, long steps, bool ignoreEndstop);
 extern void prepSteppingAbs(int index, long steps, bool ignoreEndstop = false);
 extern void prepSteppingAbsMillimeter(int index, float millimeter, bool ignoreEndstop = false);
 extern void prepSteppingRel(int index, long steps, bool ignoreEndstop = false);
 extern void prepSteppingRelMillimeter(int index, float millimeter, bool ignoreEndstop = false);
+extern bool feedToEndstop(int index, float millimeter, float overrun = 0, bool returnOnHit = false);
 extern void resetRevolver();
-extern void serialEvent();
-extern void serialEvent2();
 extern void wireReceiveEvent(int numBytes);
 extern void beep(int count);
 extern void userBeep();
@@ -158,24 +198,32 @@ extern void printEndstopState(int serial);
 extern void printPos(int index, int serial);
 extern void printAcceleration(int serial);
 extern void printSpeeds(int serial);
+extern float getStepsPerUnit(int index);
+extern void setAccelerationRate(int index, float rate);
+extern void setSpeedRate(int index, float speed);
+extern unsigned int getStepInterval(int index, float speed);
 extern void sendGList(int serial);
 extern void sendMList(int serial);
 extern void sendToolResponse(int serial);
 extern void sendStartResponse(int serial);
 extern void sendOkResponse(int serial);
-extern void sendErrorResponse(int serial, char* msg = NULL);
-extern void sendErrorResponseP(int serial, char* msg = NULL);
-extern void parseGcode(String serialBuffer, int serial);
-extern bool parse_G(String buf,int serial);
-extern bool parse_M(String buf,int serial);
-extern bool parse_T(String buf,int serial);
-extern int  getParam(String buf, char* token);
-extern bool getParamString(String buf, char* token, char* dest, int bufLen);
-extern void prepStepping(int index, long param, bool Millimeter = true, bool ignoreEndstop = false);
+extern void sendErrorResponse(int serial, const char* msg = NULL);
+extern void sendErrorResponseP(int serial, const char* msg = NULL);
+extern void parseGcode(char* line, int serial);
+extern void serviceSerial();
+extern bool parse_G(GCodeLine* gcode, int serial);
+extern bool parse_M(GCodeLine* gcode, int serial);
+extern bool parse_T(GCodeLine* gcode, int serial);
+extern void prepStepping(int index, float param, bool Millimeter = true, bool ignoreEndstop = false);
 extern void saveSettings(int serial);
 extern void reportSettings(int serial);
 extern void printResponse(const char* response, int serial);
 extern void printResponseP(const char* response, int serial);
 extern void printOffsets(int serial);
+extern void printBowdenLengths(int serial);
+extern void buildToolPositions();
+extern long getToolPosition(int index, int tool);
+extern long getBowdenSteps(int tool);
+extern void setBowdenSteps(int tool, long steps);
 
 #endif
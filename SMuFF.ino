@@ -20,27 +20,41 @@
 #include "Config.h"
 #include "ZTimerLib.h"
 #include "ZStepperLib.h"
+#include "ZMoveQueue.h"
+#include "ZLineBuffer.h"
+#include "ZCommandQueue.h"
 #include "ZServo.h"
 
 ZStepper                        steppers[NUM_STEPPERS];
 ZTimer                          stepperTimer;
+ZTimer                          feederTimer;
+ZMoveQueue                      moveQueue;
+ZLineBuffer                     lineBuffer0, lineBuffer2, lineBuffer9;
+ZCommandQueue                   commandQueue;
 ZServo                          servo(SERVO1_PIN);
 U8G2_ST7565_64128N_F_4W_HW_SPI  display(U8G2_R2, /* cs=*/ DSP_CS_PIN, /* dc=*/ DSP_DC_PIN, /* reset=*/ DSP_RESET_PIN);
 Encoder                         encoder(ENCODER1_PIN, ENCODER2_PIN);
 
 volatile byte           nextStepperFlag = 0;
 volatile byte           remainingSteppersFlag = 0;
+volatile long           lastExitSteps = 0;
+volatile int8_t         masterStepper = -1;
+volatile byte           slaveSteppersFlag = 0;
+volatile bool           feederTimerActive = false;
+volatile IsrProfile     isrProfile;
+long                    bresenhamError[NUM_STEPPERS];
+MoveBlock               nextMove;
+long                    plannedPosition[NUM_STEPPERS];
 volatile unsigned long  lastEncoderButtonTime = 0;
 bool                    testMode = false;
 int                     toolSelections[MAX_TOOLS]; 
 unsigned long           pwrSaveTime;
 bool                    isPwrSave = false;
 
-String serialBuffer0, serialBuffer2, serialBuffer9; 
 String mainList;
 String toolsList;
 String offsetsList;
-String traceSerial2;
+char   traceSerial2[16];           // start of the last line from Serial2, for the status line
 char   tmp[128];
 
 extern char _title[128];
@@ -64,6 +78,18 @@ void overrideStepZ() {
   STEP_LOW_Z
 }
 
+void isrEndstopX() {
+  steppers[SELECTOR].endstopISR();
+}
+
+void isrEndstopY() {
+  steppers[REVOLVER].endstopISR();
+}
+
+void isrEndstopZ() {
+  steppers[FEEDER].endstopISR();
+}
+
 void endstopYevent() {
   //__debug("Endstop Revolver: %d", steppers[REVOLVER].getStepPosition());
 }
@@ -74,36 +100,61 @@ void endstopZevent() {
 
 void setup() {
 
-  serialBuffer0.reserve(80);
-  serialBuffer2.reserve(80);
-  serialBuffer9.reserve(80);
-
   setupDisplay(); 
   readConfig();
 
   steppers[SELECTOR] = ZStepper(SELECTOR, "Selector", X_STEP_PIN, X_DIR_PIN, X_ENABLE_PIN, smuffConfig.acceleration_X, smuffConfig.maxSpeed_X);
-  steppers[SELECTOR].setEndstop(X_END_PIN, smuffConfig.endstopTrigger_X, ZStepper::MIN);
+  steppers[SELECTOR].setEndstop(X_END_PIN, smuffConfig.endstopTrigger_X, ZStepper::MIN, isrEndstopX);
   steppers[SELECTOR].stepFunc = overrideStepX;
   steppers[SELECTOR].setMaxStepCount(smuffConfig.maxSteps_X);
   steppers[SELECTOR].setStepsPerMM(smuffConfig.stepsPerMM_X);
   steppers[SELECTOR].setInvertDir(smuffConfig.invertDir_X);
+  steppers[SELECTOR].setRampMode((ZStepper::RampMode)smuffConfig.rampMode_X);
+  setAccelerationRate(SELECTOR, smuffConfig.accelRate_X);
+  if(smuffConfig.speed_X > 0)
+    setSpeedRate(SELECTOR, smuffConfig.speed_X);
+  steppers[SELECTOR].setHomingSpeed(getStepInterval(SELECTOR, smuffConfig.homingSpeed_X), getStepInterval(SELECTOR, smuffConfig.homingSpeedSlow_X));
+  steppers[SELECTOR].setHomingBump(smuffConfig.homingBump_X * getStepsPerUnit(SELECTOR));
 
   steppers[REVOLVER] = ZStepper(REVOLVER, "Revolver", Y_STEP_PIN, Y_DIR_PIN, Y_ENABLE_PIN, smuffConfig.acceleration_Y, smuffConfig.maxSpeed_Y);
-  steppers[REVOLVER].setEndstop(Y_END_PIN, smuffConfig.endstopTrigger_Y, ZStepper::ORBITAL);
+  steppers[REVOLVER].setEndstop(Y_END_PIN, smuffConfig.endstopTrigger_Y, ZStepper::ORBITAL, isrEndstopY);
   steppers[REVOLVER].stepFunc = overrideStepY;
   steppers[REVOLVER].setMaxStepCount(smuffConfig.stepsPerRevolution_Y);
   steppers[REVOLVER].endstopFunc = endstopYevent;
   steppers[REVOLVER].setInvertDir(smuffConfig.invertDir_Y);
+  steppers[REVOLVER].setRampMode((ZStepper::RampMode)smuffConfig.rampMode_Y);
+  setAccelerationRate(REVOLVER, smuffConfig.accelRate_Y);
+  if(smuffConfig.speed_Y > 0)
+    setSpeedRate(REVOLVER, smuffConfig.speed_Y);
+  steppers[REVOLVER].setHomingSpeed(getStepInterval(REVOLVER, smuffConfig.homingSpeed_Y), getStepInterval(REVOLVER, smuffConfig.homingSpeedSlow_Y));
+  steppers[REVOLVER].setHomingBump(smuffConfig.homingBump_Y * getStepsPerUnit(REVOLVER));
+  steppers[REVOLVER].setIndexTolerance(smuffConfig.indexTolerance_Y * getStepsPerUnit(REVOLVER));
   
   steppers[FEEDER] = ZStepper(FEEDER, "Feeder", Z_STEP_PIN, Z_DIR_PIN, Z_ENABLE_PIN, smuffConfig.acceleration_Z, smuffConfig.maxSpeed_Z);
-  steppers[FEEDER].setEndstop(Z_END_PIN, smuffConfig.endstopTrigger_Z, ZStepper::MIN);
+  steppers[FEEDER].setEndstop(Z_END_PIN, smuffConfig.endstopTrigger_Z, ZStepper::MIN, isrEndstopZ);
   steppers[FEEDER].stepFunc = overrideStepZ;
   steppers[FEEDER].setStepsPerMM(smuffConfig.stepsPerMM_Z);
   steppers[FEEDER].endstopFunc = endstopZevent;
   steppers[FEEDER].setInvertDir(smuffConfig.invertDir_Z);
+  steppers[FEEDER].setRampMode((ZStepper::RampMode)smuffConfig.rampMode_Z);
+  setAccelerationRate(FEEDER, smuffConfig.accelRate_Z);
+  if(smuffConfig.speed_Z > 0)
+    setSpeedRate(FEEDER, smuffConfig.speed_Z);
+
+  buildToolPositions();
+
+  if(smuffConfig.maxInterruptRate > 0) {
+    for(int i=0; i < NUM_STEPPERS; i++)
+      steppers[i].setMinIsrInterval(F_CPU / smuffConfig.maxInterruptRate);
+  }
 
-  stepperTimer.setupTimer(ZTimer::TIMER4, ZTimer::PRESCALER1);
+  stepperTimer.setupTimer(ZTimer::TIMER4, ZTimer::PRESCALER1, smuffConfig.freeRunningTimer);
   stepperTimer.setupTimerHook(isrTimerHandler);
+  if(smuffConfig.dedicatedTimer_Z) {
+    feederTimer.setupTimer(ZTimer::TIMER5, ZTimer::PRESCALER1, smuffConfig.freeRunningTimer);
+    feederTimer.stopTimer();
+    feederTimer.setupTimerHook(isrFeederTimer);
+  }
 
   Serial.begin(smuffConfig.serial1Baudrate);
   Serial2.begin(smuffConfig.serial2Baudrate);
@@ -168,8 +219,9 @@ void setupToolsMenu() {
 void setNextInterruptInterval() {
 
   unsigned int minDuration = 999999;
+  byte timedSteppers = remainingSteppersFlag & ~slaveSteppersFlag & ~(feederTimerActive ? _BV(FEEDER) : 0);
   for(int i = 0; i < NUM_STEPPERS; i++) {
-    if((_BV(i) & remainingSteppersFlag) && steppers[i].getDuration() < minDuration ) {
+    if((_BV(i) & timedSteppers) && steppers[i].getDuration() < minDuration ) {
       minDuration = steppers[i].getDuration();
     }
   }
@@ -177,7 +229,7 @@ void setNextInterruptInterval() {
   nextStepperFlag = 0;
   for(int i = 0; i < NUM_STEPPERS; i++) {
 
-    if ( (_BV(i) & remainingSteppersFlag) && steppers[i].getDuration() == minDuration )
+    if ( (_BV(i) & timedSteppers) && steppers[i].getDuration() == minDuration )
       nextStepperFlag |= _BV(i);
   }
 
@@ -190,35 +242,263 @@ void setNextInterruptInterval() {
 
 
 void isrTimerHandler() {
-  unsigned int tmp = stepperTimer.getOCRxA(); 
-  stepperTimer.setOCRxA(65500);
+  uint16_t isrStart = stepperTimer.getTimestamp();
+  stepperTimer.measureInterval();
+  unsigned int tmp = stepperTimer.getInterval(); 
+  if(!stepperTimer.isFreeRunning())
+    stepperTimer.setOCRxA(65500);
 
   for (int i = 0; i < NUM_STEPPERS; i++) {
-    if(!(_BV(i) & remainingSteppersFlag))
+    if(!(_BV(i) & remainingSteppersFlag) || (_BV(i) & slaveSteppersFlag))
+      continue;
+    if(i == FEEDER && feederTimerActive)
       continue;
 
     if(!(nextStepperFlag & _BV(i))) {
-      steppers[i].setDuration(steppers[i].getDuration() - tmp);
+      unsigned int duration = steppers[i].getDuration();
+      steppers[i].setDuration(duration > tmp ? duration - tmp : 0);
       continue;
     }
     
+    long stepCount = steppers[i].getStepCount();
+    uint16_t start = stepperTimer.getTimestamp();
     steppers[i].handleISR();
-    if(steppers[i].getMovementDone())
-      remainingSteppersFlag &= ~_BV(i); 
+    uint16_t cycles = stepperTimer.getTimestamp() - start;
+    if(cycles > isrProfile.stepperMax)
+      isrProfile.stepperMax = cycles;
+    if(i == masterStepper) {
+      for(stepCount = steppers[i].getStepCount() - stepCount; stepCount > 0; stepCount--)
+        stepSlaves();
+    }
+    if(steppers[i].getMovementDone()) {
+      if(i == masterStepper) {
+        // slaves end with their master, even if it has been stopped early
+        remainingSteppersFlag &= ~slaveSteppersFlag;
+        slaveSteppersFlag = 0;
+        masterStepper = -1;
+      }
+      stepperDone(i);
+    }
   }
+  checkNextMove();
   //__debug("ISR(): %d", remainingSteppersFlag);
   setNextInterruptInterval();
+  profileIsr((uint16_t)(stepperTimer.getTimestamp() - isrStart));
+}
+
+/*
+ * Cycle counts are taken from the stepper timer, which runs at F_CPU.
+ * Cycles spent in the interrupt prologue/epilogue aren't included.
+ */
+void profileIsr(unsigned int cycles) {
+  if(cycles < isrProfile.min || isrProfile.count == 0)
+    isrProfile.min = cycles;
+  if(cycles > isrProfile.max)
+    isrProfile.max = cycles;
+  isrProfile.sum += cycles;
+  isrProfile.count++;
+}
+
+void resetIsrProfile() {
+  noInterrupts();
+  memset((void*)&isrProfile, 0, sizeof(IsrProfile));
+  stepperTimer.resetMissedDeadlines();
+  for(int i = 0; i < NUM_STEPPERS; i++)
+    steppers[i].resetPeakStepRate();
+  interrupts();
+}
+
+/*
+ * Feeder only moves run on a timer of their own, which keeps the feeder out of
+ * the shared stepper interrupt. Steps coming faster than MaxInterruptRate
+ * allows are batched by handleISR(), up to 8 per interrupt, just like on the
+ * stepper timer; the step pulse and the endstop check still cost their time
+ * for every step.
+ */
+void isrFeederTimer() {
+  steppers[FEEDER].handleISR();
+  if(!steppers[FEEDER].getMovementDone()) {
+    feederTimer.setNextInterruptInterval(steppers[FEEDER].getDuration());
+    return;
+  }
+  feederTimerActive = false;
+  stepperDone(FEEDER);
+  // steppers on the stepper timer count their durations down from its last
+  // interrupt, so moves can only be started from here while it's idle
+  if(remainingSteppersFlag == 0) {
+    checkNextMove();
+    if(remainingSteppersFlag & ~(feederTimerActive ? _BV(FEEDER) : 0)) {
+      // restart the stepper timer schedule from now
+      stepperTimer.stopTimer();
+      setNextInterruptInterval();
+    }
+  }
+  if(!feederTimerActive)
+    feederTimer.stopTimer();
+}
+
+void stepperDone(int index) {
+  remainingSteppersFlag &= ~_BV(index); 
+  // a move stopped by its endstop invalidates all moves queued behind
+  if(steppers[index].getStepCount() < steppers[index].getTotalSteps()) {
+    moveQueue.clear();
+    lastExitSteps = 0;
+  }
+}
+
+/*
+ * Bresenham distribution of the master steps to all slaves of a
+ * coordinated move, so all steppers finish at the same time.
+ */
+void stepSlaves() {
+  long masterSteps = steppers[masterStepper].getTotalSteps();
+  for(int i = 0; i < NUM_STEPPERS; i++) {
+    if(!(_BV(i) & slaveSteppersFlag & remainingSteppersFlag))
+      continue;
+    bresenhamError[i] -= steppers[i].getTotalSteps();
+    if(bresenhamError[i] < 0) {
+      bresenhamError[i] += masterSteps;
+      steppers[i].handleISR(false);
+      if(steppers[i].getMovementDone())
+        stepperDone(i);
+    }
+  }
+}
+
+/*
+ * Starts the next queued move once the steppers it depends on are idle.
+ * Usually that's all of them; moves queued through queueMoveAfter() may
+ * overlap with moves of other steppers.
+ */
+void checkNextMove() {
+  if(moveQueue.isEmpty()) {
+    if(remainingSteppersFlag == 0)
+      lastExitSteps = 0;
+    return;
+  }
+  if(remainingSteppersFlag == 0) {
+    startNextMove();
+    return;
+  }
+  MoveBlock* move = moveQueue.peek();
+  if(move->waitFlags == 0 || ((move->waitFlags | move->axisFlags) & remainingSteppersFlag) != 0)
+    return;
+  // there's only one set of master/slave variables
+  if(move->axis == -1 && masterStepper != -1)
+    return;
+  // the running move belongs to another stepper, nothing to blend with
+  lastExitSteps = 0;
+  startNextMove();
+}
+
+void startNextMove() {
+  MoveBlock* move = moveQueue.peek();
+  long exitSteps = moveQueue.getExitSteps();
+  for(int i = 0; i < NUM_STEPPERS; i++) {
+    if(!(move->axisFlags & _BV(i)))
+      continue;
+    if(!move->prepared)
+      steppers[i].prepareMovement(move->steps[i], (move->ignoreEndstopFlags & _BV(i)) != 0, lastExitSteps, exitSteps);
+    remainingSteppersFlag |= _BV(i);
+  }
+  if(move->axis == -1 && !move->prepared) {
+    masterStepper = move->master;
+    slaveSteppersFlag = move->axisFlags & ~_BV(move->master);
+    for(int i = 0; i < NUM_STEPPERS; i++)
+      bresenhamError[i] = steppers[move->master].getTotalSteps() >> 1;
+    steppers[move->master].setIntervalLimit(move->intervalLimit);
+  }
+  lastExitSteps = (exitSteps > 0 && move->axis != -1) ? steppers[move->axis].getExitSteps() : 0;
+  if(move->axis == FEEDER && smuffConfig.dedicatedTimer_Z) {
+    feederTimerActive = true;
+    feederTimer.setNextInterruptInterval(steppers[FEEDER].getDuration());
+  }
+  moveQueue.pop();
 }
 
 void runNoWait(int index) {
-  if(index != -1)
-    remainingSteppersFlag |= _BV(index);
-  setNextInterruptInterval();
+  if(nextMove.axisFlags == 0 && index != -1) {
+    // stepper has been set up directly (e.g. for homing), only needs to be started
+    nextMove.axisFlags = _BV(index);
+    nextMove.prepared = true;
+  }
+  queueMove();
+}
+
+void queueMoveAfter(byte waitFlags) {
+  nextMove.waitFlags = waitFlags;
+  queueMove();
 }
 
 void runAndWait(int index) {
   runNoWait(index);
-  while(remainingSteppersFlag);
+  waitForMoveQueue();
+}
+
+bool isMoveQueueIdle() {
+  // queue must be checked first; the ISR sets the stepper flags before it frees the slot
+  return moveQueue.isEmpty() && remainingSteppersFlag == 0;
+}
+
+/*
+ * Keeps receiving while waiting, so the UART buffers don't overflow
+ * during long moves.
+ */
+void waitForMoveQueue() {
+  while(!isMoveQueueIdle())
+    serviceSerial();
+}
+
+long getPlannedPosition(int index) {
+  return isMoveQueueIdle() ? steppers[index].getStepPosition() : plannedPosition[index];
+}
+
+void addQueuedMove(int index, long steps, bool ignoreEndstop) {
+  if(steps == 0)
+    return;
+  nextMove.steps[index] = steps;
+  nextMove.axisFlags |= _BV(index);
+  if(ignoreEndstop)
+    nextMove.ignoreEndstopFlags |= _BV(index);
+}
+
+void queueMove() {
+  if(nextMove.axisFlags != 0) {
+    if(isMoveQueueIdle()) {
+      for(int i = 0; i < NUM_STEPPERS; i++)
+        plannedPosition[i] = steppers[i].getStepPosition();
+    }
+    nextMove.axis = -1;
+    nextMove.master = -1;
+    nextMove.rampSteps = 0;
+    for(int i = 0; i < NUM_STEPPERS; i++) {
+      if(!(nextMove.axisFlags & _BV(i)))
+        continue;
+      plannedPosition[i] = steppers[i].wrapPosition(plannedPosition[i] + nextMove.steps[i]);
+      if(nextMove.axisFlags == _BV(i))
+        nextMove.axis = i;
+      if(nextMove.master == -1 || abs(nextMove.steps[i]) > abs(nextMove.steps[nextMove.master]))
+        nextMove.master = i;
+      // the ramp table mustn't change under a move that's still using it
+      if(!steppers[i].isRampValid())
+        waitForMoveQueue();
+      nextMove.rampSteps = steppers[i].getRampSteps();
+    }
+    nextMove.intervalLimit = 0;
+    if(nextMove.axis == -1 && !nextMove.prepared) {
+      long masterSteps = abs(nextMove.steps[nextMove.master]);
+      for(int i = 0; i < NUM_STEPPERS; i++) {
+        if(!(nextMove.axisFlags & _BV(i)) || i == nextMove.master)
+          continue;
+        unsigned long limit = ((unsigned long)steppers[i].getMaxSpeed() * abs(nextMove.steps[i]) + masterSteps - 1) / masterSteps;
+        if(limit > nextMove.intervalLimit)
+          nextMove.intervalLimit = limit > 65535 ? 65535 : limit;
+      }
+    }
+    while(!moveQueue.push(&nextMove))
+      serviceSerial();
+  }
+  memset(&nextMove, 0, sizeof(MoveBlock));
 }
 
 static int lastTurn;
@@ -227,6 +507,7 @@ static bool lastZEndstopState = 0;
 
 void loop() {
 
+  serviceSerial();
   if(feederEndstop() != lastZEndstopState) {
     lastZEndstopState = feederEndstop();
     setSignalPort(1, feederEndstop());
@@ -275,7 +556,7 @@ void loop() {
       lastTurn = turn;
     }
   }
-  delay(100);
+  delay(100);                 // serial input keeps being serviced, delay() calls yield()
   if((millis() - pwrSaveTime)/1000 >= smuffConfig.powerSaveTimeout && !isPwrSave) {
     //__debug("Power save mode after %d seconds (%d)", (millis() - pwrSaveTime)/1000, smuffConfig.powerSaveTimeout);
     setPwrSave(1);
@@ -485,41 +766,62 @@ bool checkAutoClose() {
   return false;
 }
 
-void serialEvent() {
-  while (Serial.available()) {
-    char in = (char)Serial.read();
-    if (in == '\n') {
-      //__debug("Received: %s", serialBuffer0.c_str());
-      parseGcode(serialBuffer0, 0);
-      serialBuffer0 = "";
-    }
-    else
-      serialBuffer0 += in;
-  }
+/*
+ * Called by the Arduino core while it's waiting in delay(),
+ * so received commands don't have to wait for the next loop().
+ */
+void yield() {
+  serviceSerial();
 }
 
-void serialEvent2() {
-  while (Serial2.available()) {
-    char in = (char)Serial2.read();
-    if (in == '\n') {
-      Serial.println(serialBuffer2);
-      parseGcode(serialBuffer2, 2);
-      traceSerial2 = String(serialBuffer2);
-      serialBuffer2 = "";
+/*
+ * Moves complete lines from the interfaces into the command queue, one line
+ * per interface in turn, as long as there's room left. Lines that don't fit
+ * stay in their line buffer, so the sender gets slowed down by its pending "ok".
+ */
+void queueCommands() {
+  static ZLineBuffer* const buffers[] = { &lineBuffer0, &lineBuffer2, &lineBuffer9 };
+  static const byte ports[] = { 0, 2, 9 };
+  bool queued;
+  do {
+    queued = false;
+    for(byte i = 0; i < sizeof(ports); i++) {
+      char* line = commandQueue.reserve(ports[i]);
+      if(line == NULL)
+        return;
+      if(buffers[i]->getLine(line, MAX_GCODE_LENGTH)) {
+        commandQueue.push();
+        queued = true;
+      }
     }
-    else
-      serialBuffer2 += in;
+  } while(queued);
+}
+
+void serviceSerial() {
+  static bool processing = false;
+
+  while (Serial.available())
+    lineBuffer0.put((char)Serial.read());
+  while (Serial2.available())
+    lineBuffer2.put((char)Serial2.read());
+  queueCommands();
+  // commands may call delay() themselves, hence don't nest
+  if(processing || parserBusy || commandQueue.isEmpty())
+    return;
+  processing = true;
+  // the command gets parsed right in its slot, which stays taken until it's done
+  QueuedCommand* cmd = commandQueue.peek();
+  if(cmd->serial == 2) {
+    Serial.println(cmd->line);
+    strlcpy(traceSerial2, cmd->line, sizeof(traceSerial2));
   }
+  //__debug("Received: %s", cmd->line);
+  parseGcode(cmd->line, cmd->serial);
+  commandQueue.pop();
+  processing = false;
 }
 
 void wireReceiveEvent(int numBytes) {
-  while (Wire.available()) {
-    char in = (char)Wire.read();
-    if (in == '\n') {
-      parseGcode(serialBuffer9, 9);
-      serialBuffer9 = "";
-    }
-    else
-        serialBuffer9 += in;
-  }
+  while (Wire.available())
+    lineBuffer9.put((char)Wire.read());
 }
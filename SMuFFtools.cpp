@@ -35,10 +35,13 @@ extern char           tmp[128];
 SMuFFConfig           smuffConfig;
 int                   lastEncoderTurn = 0;
 byte                  toolSelected = -1;
-static bool           feederJamed = false;
+unsigned long         toolChangeTime = 0;
+static long           bowdenSteps[MAX_TOOLS];     // measured steps from the feeder endstop to the load point (<= 0 = not measured)
+static long           toolPositions[2][MAX_TOOLS];// selector and revolver step position of each tool
+bool                  feederJamed = false;
 PositionMode          positionMode = RELATIVE;
-static bool           displayingUserMessage = false;
-static unsigned int   userMessageTime = 0;
+bool                  displayingUserMessage = false;
+unsigned int          userMessageTime = 0;
 char                  _sel[128];
 char                  _wait[128];
 char                  _title[128];
@@ -85,7 +88,7 @@ void drawStatus() {
   display.setDrawColor(2);
   display.drawBox(0, display.getDisplayHeight()-display.getMaxCharHeight()+2, display.getDisplayWidth(), display.getMaxCharHeight());
   sprintf_P(_wait, parserBusy ? P_Busy : P_Ready);
-  sprintf(tmp, "M:%d | %-4s | %-5s ", freeMemory(), traceSerial2.c_str(), _wait);
+  sprintf(tmp, "M:%d | %-4s | %-5s ", freeMemory(), traceSerial2, _wait);
   display.drawStr(1, display.getDisplayHeight(), tmp);
   display.setFontMode(0);
   display.setDrawColor(1);
@@ -107,7 +110,7 @@ void drawSelectingMessage(int tool) {
     resetDisplay();
     sprintf_P(_sel, P_Selecting);
     sprintf_P(_wait, P_Wait);
-    if(*smuffConfig.materials[tool] != NULL) {
+    if(*smuffConfig.materials[tool] != 0) {
       sprintf(tmp,"%s", smuffConfig.materials[tool]);
     }
     else {
@@ -236,8 +239,7 @@ uint8_t u8x8_GetMenuEvent(u8x8_t *u8x8)
     }
   }
   u8x8->debounce_state = button;
-  serialEvent();
-  serialEvent2();
+  serviceSerial();
   //wireReceiveEvent(0);
   if(checkAutoClose()) {
     stat = U8X8_MSG_GPIO_MENU_HOME;
@@ -245,14 +247,15 @@ uint8_t u8x8_GetMenuEvent(u8x8_t *u8x8)
   return stat;
 }
 
-bool moveHome(int index, bool showMessage = true, bool checkFeeder = true) {
+bool moveHome(int index, bool showMessage, bool checkFeeder) {
   if(!steppers[index].getEnabled())
     steppers[index].setEnabled(true);
 
   if(feederJamed) {
     beep(4);
-    return;
+    return false;
   }
+  waitForMoveQueue();
   parserBusy = true;
   if (checkFeeder && feederEndstop()) {
     if (showMessage) {
@@ -315,6 +318,7 @@ bool showFeederFailedMessage(int state) {
   beep(3);
   int button = showDialog(P_TitleWarning, state == 1 ? P_CantLoad : P_CantUnload, P_CheckUnit, P_OkButtonOnly);
   display.clearDisplay();
+  return button == 1;
 }
 
 int showDialog(PGM_P title, PGM_P message, PGM_P addMessage, PGM_P buttons) {
@@ -332,7 +336,7 @@ void signalNoTool() {
   drawUserMessage(_msg1);
 }
 
-bool loadFilament(bool showMessage = true) {
+bool loadFilament(bool showMessage) {
   if (toolSelected == 255) {
     signalNoTool();
     return false;
@@ -347,33 +351,33 @@ bool loadFilament(bool showMessage = true) {
     steppers[FEEDER].setEnabled(true);
   if(smuffConfig.resetBeforeFeed_Y)
     resetRevolver();
-  int n = 100;
   unsigned int curSpeed = steppers[FEEDER].getMaxSpeed();
   steppers[FEEDER].setMaxSpeed(smuffConfig.insertSpeed_Z);
-  while (!feederEndstop()) {
-    prepSteppingRelMillimeter(FEEDER, 2.5, true);
+  bool hit = feedToEndstop(FEEDER, 125.0);
+  if (!hit) {
+    resetRevolver();
+    prepSteppingRelMillimeter(FEEDER, -15.0, true);
     runAndWait(FEEDER);
-    if (n == 50) {
-      resetRevolver();
-      prepSteppingRelMillimeter(FEEDER, -15.0, true);
-      runAndWait(FEEDER);
-    }
-    if (n <= 0) {
-      if (showMessage)
-        showFeederFailedMessage(1);
-      steppers[FEEDER].setMaxSpeed(curSpeed);
-      feederJamed = true;
-      parserBusy = false;
-      return false;
-    }
-    n--;
+    hit = feedToEndstop(FEEDER, 125.0);
+  }
+  if (!hit) {
+    if (showMessage)
+      showFeederFailedMessage(1);
+    steppers[FEEDER].setMaxSpeed(curSpeed);
+    steppers[FEEDER].setPositionValid(false);
+    feederJamed = true;
+    parserBusy = false;
+    return false;
   }
   feederJamed = false;
+  // from here on, the feeder position is the filament tip beyond the endstop
+  long target = getBowdenSteps(toolSelected);
+  long insert = bowdenSteps[toolSelected] > 0 ? (long)(INSERT_MARGIN * steppers[FEEDER].getStepsPerMM()) : target / 20;
   steppers[FEEDER].setMaxSpeed(curSpeed);
-  prepSteppingRelMillimeter(FEEDER, smuffConfig.bowdenLength*.95, true);
+  prepSteppingAbs(FEEDER, target - insert, true);
   runAndWait(FEEDER);
   steppers[FEEDER].setMaxSpeed(smuffConfig.insertSpeed_Z);
-  prepSteppingRelMillimeter(FEEDER, smuffConfig.bowdenLength*.05, true);
+  prepSteppingAbs(FEEDER, target, true);
   runAndWait(FEEDER);
   
   if(smuffConfig.reinforceLength > 0) {
@@ -383,14 +387,28 @@ bool loadFilament(bool showMessage = true) {
   }
   
   steppers[FEEDER].setMaxSpeed(curSpeed);
+  steppers[FEEDER].setPositionValid(true);
   EEPROM.put(EEPROM_FEEDER_POS, steppers[FEEDER].getStepPosition());
-  if(smuffConfig.homeAfterFeed)
-    steppers[REVOLVER].home();
+  if(smuffConfig.homeAfterFeed) {
+    if(smuffConfig.indexTolerance_Y <= 0 || !steppers[REVOLVER].isPositionValid())
+      steppers[REVOLVER].home();
+    else {
+      prepSteppingAbs(REVOLVER, 0, true);
+      runAndWait(REVOLVER);
+    }
+  }
   parserBusy = false;
   return true;
 }
 
-bool unloadFilament() {
+static unsigned int unloadMaxSpeed;
+
+/*
+ * If pipelined, returns as soon as the filament tip has left the selector,
+ * while the feeder may still be retracting. finishUnload() has to be called
+ * once the selector has been set in motion.
+ */
+bool unloadFilament(bool pipelined) {
   if (toolSelected == 255) {
     signalNoTool();
     return false;
@@ -405,6 +423,7 @@ bool unloadFilament() {
   if(smuffConfig.resetBeforeFeed_Y)
     resetRevolver();
   unsigned int curSpeed = steppers[FEEDER].getMaxSpeed();
+  unloadMaxSpeed = curSpeed;
   steppers[FEEDER].setEndstopState(!steppers[FEEDER].getEndstopState());
   if(smuffConfig.unloadRetract != 0) {
     prepSteppingRelMillimeter(FEEDER, smuffConfig.unloadRetract);
@@ -417,45 +436,50 @@ bool unloadFilament() {
       steppers[FEEDER].setMaxSpeed(curSpeed);
     }
   }
-  prepSteppingRelMillimeter(FEEDER, -(smuffConfig.bowdenLength*3));
-  runAndWait(FEEDER);
-  steppers[FEEDER].setMaxSpeed(smuffConfig.insertSpeed_Z);
-  int n = 200;
-  do {
-    prepSteppingRelMillimeter(FEEDER, -20.0, true);
-    runAndWait(FEEDER);
-    if(!feederEndstop()) {
-      if((n > 0 && n < 200) && n % 50 == 0) {
-        resetRevolver();
-        prepSteppingRelMillimeter(FEEDER, 15.0, true);
-        runAndWait(FEEDER);
-      }
-      if (n <= 0) {
-        showFeederFailedMessage(0);
-        steppers[FEEDER].setMaxSpeed(curSpeed);
-        feederJamed = true;
-        parserBusy = false;
-        return false;
-      }
+  // retract a known filament tip in one move, hunt for the endstop otherwise
+  float retract = smuffConfig.bowdenLength*3;
+  long tip = steppers[FEEDER].getStepPosition();
+  if(steppers[FEEDER].isPositionValid() && tip > 0)
+    retract = (float)tip / steppers[FEEDER].getStepsPerMM() + UNLOAD_MARGIN;
+  bool hit = feedToEndstop(FEEDER, -retract, UNLOAD_CLEARANCE, pipelined);
+  for(int n = 3; !hit; n--) {
+    // the feeder has stopped here, so changing its speed is safe
+    steppers[FEEDER].setMaxSpeed(smuffConfig.insertSpeed_Z);
+    if (n <= 0) {
+      showFeederFailedMessage(0);
+      steppers[FEEDER].setMaxSpeed(curSpeed);
+      steppers[FEEDER].setPositionValid(false);
+      feederJamed = true;
+      parserBusy = false;
+      return false;
     }
-    n--;
-  } while (!feederEndstop());
+    resetRevolver();
+    prepSteppingRelMillimeter(FEEDER, 15.0, true);
+    runAndWait(FEEDER);
+    hit = feedToEndstop(FEEDER, -1000.0, UNLOAD_CLEARANCE, pipelined);
+  }
   feederJamed = false;
-  steppers[FEEDER].setMaxSpeed(curSpeed);
+  if(!pipelined)
+    finishUnload();
+  return true;
+}
+
+void finishUnload() {
+  waitForMoveQueue();
+  steppers[FEEDER].setMaxSpeed(unloadMaxSpeed);
   steppers[FEEDER].setEndstopState(!steppers[FEEDER].getEndstopState());
-  steppers[FEEDER].setStepPosition(0);
+  steppers[FEEDER].setPositionValid(true);
   EEPROM.put(EEPROM_FEEDER_POS, steppers[FEEDER].getStepPosition());
   parserBusy = false;
-  return true;
 }
 
-bool selectTool(int ndx, bool showMessage = true) {
+bool selectTool(int ndx, bool showMessage) {
   if(feederJamed) {
     beep(4);
     sprintf_P(_msg1, P_FeederJamed);
     strcat_P(_msg1, P_Aborting);
     drawUserMessage(_msg1);
-    return;
+    return false;
   }
   signalSelectorBusy();
   if(toolSelected == ndx) {
@@ -466,34 +490,48 @@ bool selectTool(int ndx, bool showMessage = true) {
       resetRevolver();
       signalSelectorReady();
     }
-    return;
+    return true;
   }
   if(!steppers[SELECTOR].getEnabled())
     steppers[SELECTOR].setEnabled(true);
   
+  unsigned long start = millis();
+  bool unloading = false;
   if (showMessage) {
     while(feederEndstop()) {
       if (!showFeederLoadedMessage())
-        return;
+        return false;
     }
   }
   else {
     if (!smuffConfig.externalControl_Z && feederEndstop()) {
-      unloadFilament();
+      unloading = unloadFilament(true);
     }
   }
   //__debug("Selecting tool: %d", ndx);
   parserBusy = true;
   drawSelectingMessage(ndx);
-  prepSteppingAbsMillimeter(SELECTOR, smuffConfig.firstToolOffset + (ndx * smuffConfig.toolSpacing));
-  remainingSteppersFlag |= _BV(SELECTOR);
-  if(!smuffConfig.resetBeforeFeed_Y) {
-    prepSteppingAbs(REVOLVER, smuffConfig.firstRevolverOffset + (ndx *smuffConfig.revolverSpacing), true);
-    remainingSteppersFlag |= _BV(REVOLVER);
-  }
-  runAndWait(-1);
+  // while the feeder is still retracting, the selector may move as soon as
+  // the filament tip has left it, but the revolver has to hold the filament
+  // until the feeder has stopped; so both get their own block, which the
+  // ISR starts as soon as they're free. Otherwise selector and revolver run
+  // as one coordinated move. With ResetBeforeFeed the revolver gets set by
+  // loadFilament().
+  prepSteppingAbs(SELECTOR, getToolPosition(SELECTOR, ndx));
+  if(unloading)
+    queueMoveAfter(_BV(SELECTOR));
+  if(!smuffConfig.resetBeforeFeed_Y)
+    prepSteppingAbs(REVOLVER, getToolPosition(REVOLVER, ndx), true);
+  if(unloading)
+    queueMoveAfter(_BV(REVOLVER) | _BV(FEEDER));
+  else
+    runNoWait(-1);
+  waitForMoveQueue();
+  if(unloading)
+    finishUnload();
   toolSelected = ndx;
   EEPROM.put(EEPROM_TOOL, toolSelected);
+  toolChangeTime = millis() - start;
   for (int i = 0; i < NUM_STEPPERS; i++) {
     EEPROM.put(i * sizeof(long), steppers[i].getStepPosition());
   }
@@ -512,42 +550,83 @@ bool selectTool(int ndx, bool showMessage = true) {
 
 void resetRevolver() {
   //__debug("resetting revolver");
-  moveHome(REVOLVER, false, false);
+  // the endstop acts as index pulse, homing is only needed if the position has drifted
+  if(smuffConfig.indexTolerance_Y <= 0 || !steppers[REVOLVER].isPositionValid())
+    moveHome(REVOLVER, false, false);
   //__debug("DONE resetting revolver");
   if (toolSelected > -1) {
-    prepSteppingAbs(REVOLVER, smuffConfig.firstRevolverOffset + (toolSelected*smuffConfig.revolverSpacing), true);
+    prepSteppingAbs(REVOLVER, getToolPosition(REVOLVER, toolSelected), true);
     runAndWait(REVOLVER);
   }
 }
 
+/*
+ * Precomputes the selector and revolver positions of all tools, including
+ * their trims. Has to be called whenever offsets, spacings or trims change.
+ */
+void buildToolPositions() {
+  for(int i = 0; i < MAX_TOOLS; i++) {
+    float mm = smuffConfig.firstToolOffset + i * smuffConfig.toolSpacing + smuffConfig.toolTrim_X[i];
+    toolPositions[SELECTOR][i] = lround(mm * smuffConfig.stepsPerMM_X);
+    toolPositions[REVOLVER][i] = steppers[REVOLVER].wrapPosition(smuffConfig.firstRevolverOffset + (long)i * smuffConfig.revolverSpacing + smuffConfig.toolTrim_Y[i]);
+  }
+}
+
+/*
+ * Step position of a tool on the selector or the revolver.
+ * Tools out of range return the planned position, i.e. there's nothing to move.
+ */
+long getToolPosition(int index, int tool) {
+  if(index > REVOLVER || tool < 0 || tool >= MAX_TOOLS)
+    return getPlannedPosition(index);
+  return toolPositions[index][tool];
+}
+
 void setStepperSteps(int index, long steps, bool ignoreEndstop) {
   if (steps != 0)
-    steppers[index].prepareMovement(steps, ignoreEndstop);
+    addQueuedMove(index, steps, ignoreEndstop);
 }
 
-void prepSteppingAbs(int index, long steps, bool ignoreEndstop = false) {
-  long pos = steppers[index].getStepPosition();
-  long _steps = steps - pos;
+void prepSteppingAbs(int index, long steps, bool ignoreEndstop) {
+  long pos = getPlannedPosition(index);
+  long _steps = steppers[index].getOrbitalDelta(pos, steps);
   setStepperSteps(index, _steps, ignoreEndstop);
 }
 
-void prepSteppingAbsMillimeter(int index, float millimeter, bool ignoreEndstop = false) {
+void prepSteppingAbsMillimeter(int index, float millimeter, bool ignoreEndstop) {
   unsigned int stepsPerMM = steppers[index].getStepsPerMM();
   long steps = (long)((float)millimeter * stepsPerMM);
-  long pos = steppers[index].getStepPosition();
+  long pos = getPlannedPosition(index);
   setStepperSteps(index, steps - pos, ignoreEndstop);
 }
 
-void prepSteppingRel(int index, long steps, bool ignoreEndstop = false) {
+void prepSteppingRel(int index, long steps, bool ignoreEndstop) {
   setStepperSteps(index, steps, ignoreEndstop);
 }
 
-void prepSteppingRelMillimeter(int index, float millimeter, bool ignoreEndstop = false) {
+void prepSteppingRelMillimeter(int index, float millimeter, bool ignoreEndstop) {
   unsigned int stepsPerMM = steppers[index].getStepsPerMM();
   long steps = (long)((float)millimeter * stepsPerMM);
   setStepperSteps(index, steps, ignoreEndstop);
 }
 
+/*
+ * Runs one continuous move of at most 'millimeter' that ends 'overrun'
+ * millimeter (or the ramp down) behind the endstop trigger point, which
+ * becomes the new origin. If returnOnHit is set, returns as soon as the
+ * endstop has been triggered, while the stepper is still running on.
+ * Returns true if the endstop has been hit.
+ */
+bool feedToEndstop(int index, float millimeter, float overrun, bool returnOnHit) {
+  unsigned int stepsPerMM = steppers[index].getStepsPerMM();
+  waitForMoveQueue();
+  steppers[index].prepareMovementToEndstop((long)((float)millimeter * stepsPerMM), (long)(overrun * stepsPerMM));
+  runNoWait(index);
+  while(!isMoveQueueIdle() && !(returnOnHit && steppers[index].getEndstopLatched()))
+    serviceSerial();
+  return steppers[index].getEndstopLatched();
+}
+
 void printEndstopState(int serial) {
   sprintf(tmp, "Selector: %s\tRevolver: %s\tFeeder: %s\n",
           selectorEndstop()  ? "triggered" : "open",
@@ -556,19 +635,53 @@ void printEndstopState(int serial) {
   printResponse(tmp, serial);
 }
 
+/*
+ * Steps per physical unit: millimeters on Selector and Feeder, degrees on the Revolver.
+ */
+float getStepsPerUnit(int index) {
+  if(index == REVOLVER)
+    return (float)smuffConfig.stepsPerRevolution_Y / 360;
+  return steppers[index].getStepsPerMM();
+}
+
+void setAccelerationRate(int index, float rate) {
+  steppers[index].setAccelRate((unsigned long)(rate * getStepsPerUnit(index)));
+}
+
+void setSpeedRate(int index, float speed) {
+  steppers[index].setMaxStepRate((unsigned long)(speed * getStepsPerUnit(index)));
+}
+
+unsigned int getStepInterval(int index, float speed) {
+  if(speed <= 0)
+    return 0;
+  unsigned long interval = (unsigned long)(F_CPU / (speed * getStepsPerUnit(index)));
+  return interval < 1 ? 1 : (interval > 0xFFFF ? 0xFFFF : interval);
+}
+
+String getSpeedString(int index) {
+  return String((long)(steppers[index].getMaxStepRate() / getStepsPerUnit(index)));
+}
+
+String getAccelerationString(int index) {
+  if(steppers[index].getAccelRate() == 0 || steppers[index].getRampMode() == ZStepper::LINEAR)
+    return "linear";
+  return String((long)(steppers[index].getAccelRate() / getStepsPerUnit(index)));
+}
+
 void printSpeeds(int serial) {
   sprintf_P(tmp, P_AccelSpeed,
-          String(steppers[SELECTOR].getMaxSpeed()).c_str(),
-          String(steppers[REVOLVER].getMaxSpeed()).c_str(),
-          smuffConfig.externalControl_Z ? "external" : String(steppers[FEEDER].getMaxSpeed()).c_str());
+          getSpeedString(SELECTOR).c_str(),
+          getSpeedString(REVOLVER).c_str(),
+          smuffConfig.externalControl_Z ? "external" : getSpeedString(FEEDER).c_str());
   printResponse(tmp, serial);
 }
 
 void printAcceleration(int serial) {
   sprintf_P(tmp, P_AccelSpeed,
-          String(steppers[SELECTOR].getAcceleration()).c_str(),
-          String(steppers[REVOLVER].getAcceleration()).c_str(),
-          smuffConfig.externalControl_Z ? "external" : String(steppers[FEEDER].getAcceleration()).c_str());
+          getAccelerationString(SELECTOR).c_str(),
+          getAccelerationString(REVOLVER).c_str(),
+          smuffConfig.externalControl_Z ? "external" : getAccelerationString(FEEDER).c_str());
   printResponse(tmp, serial);
 }
 
@@ -578,6 +691,38 @@ void printOffsets(int serial) {
           String(smuffConfig.firstRevolverOffset).c_str(),
           "--");
   printResponse(tmp, serial);
+  for(int i = 0; i < smuffConfig.toolCount; i++) {
+    if(smuffConfig.toolTrim_X[i] == 0 && smuffConfig.toolTrim_Y[i] == 0)
+      continue;
+    sprintf_P(tmp, P_ToolTrim, i, (int)lround(smuffConfig.toolTrim_X[i]*10), smuffConfig.toolTrim_Y[i]);
+    printResponse(tmp, serial);
+  }
+}
+
+/*
+ * Steps from the feeder endstop to the load point of the given tool.
+ * Tools that haven't been measured yet use the configured bowden length.
+ */
+long getBowdenSteps(int tool) {
+  if(tool >= 0 && tool < MAX_TOOLS && bowdenSteps[tool] > 0)
+    return bowdenSteps[tool];
+  return (long)(smuffConfig.bowdenLength * steppers[FEEDER].getStepsPerMM());
+}
+
+void setBowdenSteps(int tool, long steps) {
+  if(tool < 0 || tool >= MAX_TOOLS)
+    return;
+  bowdenSteps[tool] = steps;
+  EEPROM.put(EEPROM_BOWDEN_STEPS + tool * sizeof(long), steps);
+}
+
+void printBowdenLengths(int serial) {
+  for(int i = 0; i < smuffConfig.toolCount; i++) {
+    sprintf_P(tmp, P_BowdenLength, i,
+          String((float)getBowdenSteps(i) / steppers[FEEDER].getStepsPerMM()).c_str(),
+          bowdenSteps[i] > 0 ? "measured" : "default");
+    printResponse(tmp, serial);
+  }
 }
 
 void printPos(int index, int serial) {
@@ -610,10 +755,14 @@ void getEepromData() {
   EEPROM.get(EEPROM_SELECTOR_POS, pos);
   steppers[SELECTOR].setStepPosition(pos);
   EEPROM.get(EEPROM_REVOLVER_POS, pos);
-  steppers[REVOLVER].setStepPosition(pos);
+  steppers[REVOLVER].setStepPosition(steppers[REVOLVER].wrapPosition(pos));
   EEPROM.get(EEPROM_FEEDER_POS, pos);
   steppers[FEEDER].setStepPosition(pos);
+  // the stored filament tip is trusted as long as it agrees with the endstop
+  steppers[FEEDER].setPositionValid(feederEndstop() == (pos > 0));
 
+  for(int i = 0; i < MAX_TOOLS; i++)
+    EEPROM.get(EEPROM_BOWDEN_STEPS + i * sizeof(long), bowdenSteps[i]);
   EEPROM.get(EEPROM_TOOL, toolSelected);
   EEPROM.get(EEPROM_CONTRAST, smuffConfig.lcdContrast);
 
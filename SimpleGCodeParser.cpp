@@ -28,95 +28,184 @@
 
 extern ZStepper steppers[NUM_STEPPERS];
 char ptmp[80];
-static bool parserBusy = false;
+bool parserBusy = false;
 unsigned int currentLine = 0;
 
-void parseGcode(String serialBuffer, int serial) {
+/*
+ * Parses and executes a line received on the given interface.
+ * The line buffer gets modified in place.
+ */
+void parseGcode(char* line, int serial) {
 
     if(parserBusy) {
       sendErrorResponseP(serial, P_Busy);
       return;
     }
-    serialBuffer.replace(" ","");
-    serialBuffer.replace("\r","");
-    serialBuffer.replace("\n","");
-    
-    if(serialBuffer.length()==0)
+    GCodeLine gcode;
+    if(!tokenizeGcode(line, &gcode))
       return;
 
-    String line = String(serialBuffer);
     parserBusy = true;
-    int pos;
-    if((pos = line.lastIndexOf("*")) > -1) {
-      line = line.substring(0, pos);
-    }
-    if((pos = line.lastIndexOf(";")) > -1) {
-      if(pos==0)
-      return;
-      line = line.substring(0, pos);
-    }
-    if(line.startsWith("N")) {
-      char ln[15];
-      if((currentLine = getParam(line, "N")) != -1) {
-        sprintf(ln, "%d\0", currentLine);
-        line = line.substring(strlen(ln)+1);
+    if(gcode.lineNumber != -1)
+      currentLine = gcode.lineNumber;
+    //__debug("Line: %c%d %s", gcode.cmd, gcode.code, gcode.params.text);
+    bool stat;
+    switch(gcode.cmd) {
+      case 'G': stat = parse_G(&gcode, serial); break;
+      case 'M': stat = parse_M(&gcode, serial); break;
+      case 'T': stat = parse_T(&gcode, serial); break;
+      default: {
+        char tmp[MAX_GCODE_LENGTH + 24];
+        strcpy_P(tmp, P_UnknownCmd);
+        sprintf(tmp + strlen(tmp), " '%s'\n", line);
+        //__debug("Err: %s", tmp);
+        sendErrorResponse(serial, tmp);
+        parserBusy = false;
+        return;
       }
     }
-    //__debug("Line: %s %d", line.c_str(), line.length());
-    if(line.startsWith("G")) {
-      if(parse_G(line.substring(1), serial))
-        sendOkResponse(serial);  
-      else
-        sendErrorResponseP(serial);
-      parserBusy = false;
-      return;
-    }
-    else if(line.startsWith("M")) {
-      if(parse_M(line.substring(1), serial))
-        sendOkResponse(serial);  
-      else
-        sendErrorResponseP(serial);
-      parserBusy = false;
-      return;
-    }
-    else if(line.startsWith("T")) {
-      if(parse_T(line.substring(1), serial))
-        sendOkResponse(serial);  
-      else
-        sendErrorResponseP(serial);  
-      parserBusy = false;
-      return;
+    if(stat)
+      sendOkResponse(serial);
+    else
+      sendErrorResponseP(serial);
+    parserBusy = false;
+}
+
+static char* skipBlanks(char* p) {
+  while(*p == ' ' || *p == '\t')
+    p++;
+  return p;
+}
+
+/*
+ * Parses the number of a parameter, which is a decimal without an exponent
+ * ("X1E3" is X1 and E3). Sets end behind the number, or to s if there's none.
+ */
+static float parseNumber(char* s, char** end) {
+  char* p = s;
+  if(*p == '-' || *p == '+')
+    p++;
+  bool digits = false;
+  for(; *p >= '0' && *p <= '9'; p++)
+    digits = true;
+  if(*p == '.') {
+    for(p++; *p >= '0' && *p <= '9'; p++)
+      digits = true;
+  }
+  if(!digits) {
+    *end = s;
+    return 0;
+  }
+  *end = p;
+  char c = *p;
+  *p = 0;                   // keep strtod() from reading on
+  float value = strtod(s, NULL);
+  *p = c;
+  return value;
+}
+
+/*
+ * Splits a line into line number, command, code and parameters in a single
+ * pass without any heap allocation. Whitespace (except within quotes) is
+ * removed from the parameters, comments and checksums are cut off, parameter
+ * values are parsed. Lines with a command other than G, M or T are left as
+ * received, for the error message.
+ * Returns false if there's nothing to execute.
+ */
+bool tokenizeGcode(char* line, GCodeLine* gcode) {
+  char* p = skipBlanks(line);
+  gcode->lineNumber = -1;
+  if(*p == 'N') {
+    gcode->lineNumber = strtol(p+1, &p, 10);
+    p = skipBlanks(p);
+  }
+  gcode->cmd = *p;
+  if(*p == 0 || *p == ';' || *p == '*')
+    return false;
+  char* end;
+  gcode->code = (int)strtol(++p, &end, 10);
+  gcode->hasCode = end != p;
+  p = end;
+
+  GCodeParams* params = &gcode->params;
+  params->text = p;
+  params->present = 0;
+  if(gcode->cmd != 'G' && gcode->cmd != 'M' && gcode->cmd != 'T')
+    return true;
+
+  char* dst = p;
+  bool quoted = false;
+  for(char* src = p; *src; src++) {
+    char c = *src;
+    if(c == '"')
+      quoted = !quoted;
+    else if(!quoted) {
+      if(c == ';' || c == '*')
+        break;
+      if(c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        continue;
     }
-    else {
-      char tmp[256];
-      sprintf(tmp, "%S '%s'\n", P_UnknownCmd, line.c_str());
-      //__debug("Err: %s", tmp);
-      sendErrorResponse(serial, tmp);
+    *dst++ = c;
+  }
+  *dst = 0;
+
+  quoted = false;
+  for(; *p; p++) {
+    if(*p == '"')
+      quoted = !quoted;
+    else if(!quoted && *p >= 'A' && *p <= 'Z') {
+      params->present |= PARAM_MASK(*p);
+      params->value[*p - 'A'] = parseNumber(p+1, &end);
+      p = end-1;
     }
-    parserBusy = false;
+  }
+  return true;
+}
+
+bool hasParam(GCodeParams* params, char letter) {
+  return (params->present & PARAM_MASK(letter)) != 0;
+}
+
+/*
+ * Sets value if the parameter has been given; returns false otherwise.
+ */
+bool getParam(GCodeParams* params, char letter, int* value) {
+  if(!hasParam(params, letter))
+    return false;
+  *value = (int)params->value[letter - 'A'];
+  return true;
 }
 
-bool parse_T(String buf, int serial) {
+bool getParam(GCodeParams* params, char letter, float* value) {
+  if(!hasParam(params, letter))
+    return false;
+  *value = params->value[letter - 'A'];
+  return true;
+}
+
+bool parse_T(GCodeLine* gcode, int serial) {
   bool stat = true;
 
-  if(buf.length()==0) {
+  if(!gcode->hasCode) {
     sendToolResponse(serial);
     return stat;
   }
-  int tool = buf.toInt();
+  int tool = gcode->code;
   int param;
 
   char msg[10];
   sprintf_P(msg, P_TResponse, tool);
-  int ofs = String(msg).length()-2;
 
   if(tool == -1 || tool == 255) {
-    parse_G(String("28"), serial);
+    char home[] = "G28";
+    GCodeLine g28;
+    tokenizeGcode(home, &g28);
+    parse_G(&g28, serial);
   }
   else if(tool >= 0 && tool <= smuffConfig.toolCount-1) {
     stat = selectTool(tool, false);
     if(stat) {
-      if((param = getParam(buf.substring(ofs), "S")) != -1) {
+      if(getParam(&gcode->params, 'S', &param)) {
         if(param == 1)
           loadFilament(false);
         else if(param == 0)
@@ -133,109 +222,97 @@ bool parse_T(String buf, int serial) {
   return stat;
 }
 
-bool parse_G(String buf, int serial) {
-  bool stat = true;
+/*
+ * Binary search for the handler of a code in one of the (sorted) dispatch
+ * tables in PROGMEM. Returns NULL for unknown codes.
+ */
+GCodeFunc findGCodeFunc(const GCodeFunctions* table, int count, int code) {
+  int lo = 0;
+  int hi = count - 1;
+  while(lo <= hi) {
+    int mid = (lo + hi) >> 1;
+    int midCode = (int)pgm_read_word(&table[mid].code);
+    if(midCode == code)
+      return (GCodeFunc)pgm_read_ptr(&table[mid].func);
+    if(midCode < code)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return NULL;
+}
 
-  if(buf.length()==0) {
+bool parse_G(GCodeLine* gcode, int serial) {
+  if(!gcode->hasCode) {
     sendGList(serial);
-    return stat;
+    return true;
   }
-  int code = buf.toInt();
-  //__debug("G[%s]: >%d< %d", buf.c_str(), code, buf.length());
-  int param;
+  int code = gcode->code;
+  //__debug("G[%s]: >%d<", gcode->params.text, code);
   
   char msg[10];
   sprintf_P(msg, P_GResponse, code);
-  int ofs = String(msg).length()-2;
 
-  for(int i=0; i< 999; i++) {
-    if(gCodeFuncsG[i].code == -1)
-      break;
-    if(gCodeFuncsG[i].code == code) {
-      return gCodeFuncsG[i].func(msg, buf.substring(ofs), serial);
-    }
-  }
-  char tmp[256];
-  sprintf_P(tmp, P_UnknownCmd, buf.c_str());
+  GCodeFunc func = findGCodeFunc(gCodeFuncsG, gCodeFuncsGCount, code);
+  if(func != NULL)
+    return func(msg, &gcode->params, serial);
   return false;
 }
 
-bool parse_M(String buf, int serial) {
-  bool stat = true;
-  
-  if(buf.length()==0) {
+bool parse_M(GCodeLine* gcode, int serial) {
+  if(!gcode->hasCode) {
     sendMList(serial);
-    return stat;
+    return true;
   }
-  int code = buf.toInt();
-  int param;
+  int code = gcode->code;
  
   char msg[10];
   sprintf_P(msg, P_MResponse, code);
-  int ofs = String(msg).length()-2;
-
-  for(int i=0; i< 999; i++) {
-    if(gCodeFuncsM[i].code == -1)
-      break;
-    if(gCodeFuncsM[i].code == code) {
-      //__debug("Calling: M", gCodeFuncsM[i].code);
-      return gCodeFuncsM[i].func(msg, buf.substring(ofs), serial);
-    }
-  }
-  char tmp[256];
-  sprintf_P(tmp, P_UnknownCmd, buf.c_str());
-  return false;
-}
 
-int getParam(String buf, char* token) {
-  int pos = buf.indexOf(token);
-  //__debug("getParam: %s\n",buf.c_str());
-  if(pos != -1) {
-    //__debug("getParam:pos: %d",pos);
-    if(buf.charAt(pos+1)=='-') {
-      int val = buf.substring(pos+2).toInt();
-      //__debug("Negative: %d", 0-val);
-      return 0-val;
-    }
-    return buf.substring(pos+1).toInt();
+  GCodeFunc func = findGCodeFunc(gCodeFuncsM, gCodeFuncsMCount, code);
+  if(func != NULL) {
+    //__debug("Calling: M%d", code);
+    return func(msg, &gcode->params, serial);
   }
-  else 
-    return -1; 
+  return false;
 }
 
-bool getParamString(String buf, char* token, char* dest, int bufLen) {
-  int pos = buf.indexOf(token);
-  //__debug("getParamString: %s\n",buf.c_str());
-  if(pos != -1) {
-    if(buf.substring(pos+1).startsWith("\"")) {
-      int endPos = buf.substring(pos+2).indexOf("\"");
-      //__debug("End of string: %d\n", endPos);
-      if(endPos != -1) {
+/*
+ * Copies the quoted string following the parameter letter into dest.
+ */
+bool getParamString(GCodeParams* params, char letter, char* dest, int bufLen) {
+  if(!hasParam(params, letter))
+    return false;
+  bool quoted = false;
+  for(const char* p = params->text; *p; p++) {
+    if(*p == '"')
+      quoted = !quoted;
+    else if(!quoted && *p == letter) {
+      if(p[1] != '"')
+        return false;
+      const char* endPos = strchr(p+2, '"');
+      if(endPos == NULL || endPos-(p+2) >= bufLen)
+        return false;
+      if(dest != NULL) {
         memset(dest, 0, bufLen);
-        if(endPos+1 < bufLen) {
-          if(dest != NULL) {
-            buf.substring(pos+2, endPos+3).toCharArray(dest, endPos+1);
-            //__debug("ptmp: >%s< (%d)\n", dest, strlen(dest));
-          }
-          return true;
-        }
+        memcpy(dest, p+2, endPos-(p+2));
       }
+      return true;
     }
   }
   return false;
 }
 
-void prepStepping(int index, long param, bool Millimeter = true, bool ignoreEndstop = false) {
+void prepStepping(int index, float param, bool Millimeter, bool ignoreEndstop) {
   if(param != 0) {
     if(positionMode == RELATIVE) {
-      if(Millimeter) prepSteppingRelMillimeter(index, param);
-      else prepSteppingRel(index, param);
+      if(Millimeter) prepSteppingRelMillimeter(index, param, ignoreEndstop);
+      else prepSteppingRel(index, (long)param, ignoreEndstop);
     }
     else {
-      if(Millimeter) prepSteppingAbsMillimeter(index, param);
-      else prepSteppingAbs(index, param);
+      if(Millimeter) prepSteppingAbsMillimeter(index, param, ignoreEndstop);
+      else prepSteppingAbs(index, (long)param, ignoreEndstop);
     }
-    remainingSteppersFlag |= _BV(index);
   }
 }
 
@@ -253,12 +330,12 @@ void sendToolResponse(int serial) {
   printResponse(tmp, serial);
 }
 
-void sendErrorResponse(int serial, char* msg = NULL) {
+void sendErrorResponse(int serial, const char* msg) {
   printResponse(msg, serial);
   sendOkResponse(serial);
 }
 
-void sendErrorResponseP(int serial, char* msg = NULL) {
+void sendErrorResponseP(int serial, const char* msg) {
   char tmp[128];
   sprintf_P(tmp, P_Error, msg == NULL ? "" : msg);
   printResponse(tmp, serial);
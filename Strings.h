@@ -78,6 +78,15 @@ const char P_ToolSelected[] PROGMEM   = { "%3d: Tool selected = %d\n" };
 const char P_Contrast[] PROGMEM       = { "%3d: Display contrast = %d\n" };
 const char P_ToolsConfig[] PROGMEM    = { "%3d: Tools configured = %d\n" };
 const char P_AccelSpeed[] PROGMEM     = { "X (Selector):\t%s\nY (Revolver):\t%s\nZ (Feeder):\t%s\n" };
+const char P_IsrProfile[] PROGMEM     = { "ISR cycles:\t%u/%u/%u\nISR count:\t%lu\nStepper max:\t%u\nMissed:\t\t%lu\nPeak steps/s:\n" };
+const char P_HomingTime[] PROGMEM     = { "Last homing (ms):\n" };
+const char P_IndexDrift[] PROGMEM     = { "Revolver drift:\t%ld steps (%s)\n" };
+const char P_ToolChangeTime[] PROGMEM = { "Last tool change:\t%lu ms\n" };
+const char P_LineStats[] PROGMEM      = { "Port %d:\t\t%lu lines, %lu dropped\n" };
+const char P_CommandQueue[] PROGMEM   = { "Queued commands:\t%d of %d (max. %d)\n" };
+const char P_BowdenLength[] PROGMEM   = { "T%d:\t%s mm (%s)\n" };
+const char P_ToolTrim[] PROGMEM       = { "T%d trim:\tX%d Y%d\n" };
+const char P_TimerDiag[] PROGMEM      = { "Timer:\t\t%s\nMeasure:\t%s\nPeriods:\t%lu\nDev. ticks:\t%d/%d/%d\nMissed:\t\t%lu\n" };
 
 const char P_CurrentTool[] PROGMEM    = {"Tool    " };
 const char P_Feed[] PROGMEM           = {"Feed    " };
@@ -117,13 +126,16 @@ const char P_MCmds[] PROGMEM = {
   "M206\t-\tSet offsets\n" \
   "M250\t-\tLCD contrast\n" \
   "M300\t-\tBeep\n" \
+  "M400\t-\tWait for moves to finish\n" \
   "M500\t-\tSave settings\n" \
   "M503\t-\tReport settings\n" \
   "M700\t-\tLoad filament\n" \
   "M701\t-\tUnload filament\n" \
+  "M705\t-\tBowden length per tool\n" \
   "M999\t-\tReset\n" \
   "M2000\t-\tText to decimal\n" \
-  "M2001\t-\tDecimal to text\n"};
+  "M2001\t-\tDecimal to text\n" \
+  "M2002\t-\tReport and reset ISR profile\n"};
 
                              
 #endif
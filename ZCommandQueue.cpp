@@ -0,0 +1,43 @@
+/**
+ * SMuFF Firmware
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Module implementing a queue for received commands
+ */
+
+#include "ZCommandQueue.h"
+
+char* ZCommandQueue::reserve(int serial) {
+  if(isFull())
+    return NULL;
+  _commands[_head].serial = (byte)serial;
+  return _commands[_head].line;
+}
+
+void ZCommandQueue::push() {
+  _head = (_head + 1) & COMMAND_QUEUE_MASK;
+  byte count = getCount();
+  if(count > _maxCount)
+    _maxCount = count;
+}
+
+void ZCommandQueue::pop() {
+  if(!isEmpty())
+    _tail = (_tail + 1) & COMMAND_QUEUE_MASK;
+}
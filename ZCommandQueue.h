@@ -0,0 +1,66 @@
+/**
+ * SMuFF Firmware
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <Arduino.h>
+#include "Config.h"
+#include "GCodes.h"
+
+#ifndef _ZCOMMANDQUEUE_H
+#define _ZCOMMANDQUEUE_H
+
+#if (COMMAND_QUEUE_SIZE & (COMMAND_QUEUE_SIZE - 1)) != 0
+#error COMMAND_QUEUE_SIZE must be a power of two
+#endif
+#define COMMAND_QUEUE_MASK  (COMMAND_QUEUE_SIZE - 1)
+
+typedef struct {
+  byte    serial;                       // interface the line has been received on
+  char    line[MAX_GCODE_LENGTH];
+} QueuedCommand;
+
+/*
+ * Complete lines from all interfaces, kept in order of arrival
+ * until the parser is ready to execute them. The parser works on the
+ * line in its slot, which gets popped once the command is done.
+ * Both sides run in the main loop (or in yield()).
+ */
+
+class ZCommandQueue {
+public:
+  ZCommandQueue() { };
+
+  bool          isEmpty() { return _head == _tail; }
+  bool          isFull() { return ((_head + 1) & COMMAND_QUEUE_MASK) == _tail; }
+  byte          getCount() { return (_head - _tail) & COMMAND_QUEUE_MASK; }
+  byte          getCapacity() { return COMMAND_QUEUE_MASK; }
+  byte          getMaxCount() { return _maxCount; }
+  char*         reserve(int serial);    // slot to copy the next line into, NULL if full
+  void          push();                 // publish the slot obtained by reserve()
+  QueuedCommand* peek() { return &_commands[_tail]; }
+  void          pop();
+
+private:
+  QueuedCommand _commands[COMMAND_QUEUE_SIZE];
+  byte          _head = 0;
+  byte          _tail = 0;
+  byte          _maxCount = 0;          // statistics, highest depth seen
+};
+
+#endif
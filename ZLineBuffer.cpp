@@ -0,0 +1,68 @@
+/**
+ * SMuFF Firmware
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Module implementing a ring buffer for received lines
+ */
+
+#include "ZLineBuffer.h"
+
+void ZLineBuffer::put(char c) {
+  if(c == '\r')
+    return;
+  if(_discard) {
+    if(c == '\n')
+      _discard = false;
+    return;
+  }
+  byte head = _head;
+  if(((head + 1) & LINE_BUFFER_MASK) == _tail) {
+    // drop what has been received of this line so far
+    _head = _lineStart;
+    _overflows++;
+    _discard = c != '\n';
+    return;
+  }
+  _buffer[head] = c;
+  head = (head + 1) & LINE_BUFFER_MASK;
+  _head = head;
+  if(c == '\n') {
+    _lineStart = head;
+    __asm__ __volatile__ ("" ::: "memory");   // line must be complete before it gets published
+    _linesIn++;
+    _linesReceived++;
+  }
+}
+
+bool ZLineBuffer::getLine(char* dest, int size) {
+  if(_linesIn == _linesOut)
+    return false;
+  byte tail = _tail;
+  int len = 0;
+  char c;
+  while((c = _buffer[tail]) != '\n') {
+    if(len < size-1)
+      dest[len++] = c;
+    tail = (tail + 1) & LINE_BUFFER_MASK;
+  }
+  dest[len] = 0;
+  _tail = (tail + 1) & LINE_BUFFER_MASK;
+  _linesOut++;
+  return true;
+}
@@ -0,0 +1,60 @@
+/**
+ * SMuFF Firmware
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <Arduino.h>
+#include "Config.h"
+
+#ifndef _ZLINEBUFFER_H
+#define _ZLINEBUFFER_H
+
+#if LINE_BUFFER_SIZE > 256 || (LINE_BUFFER_SIZE & (LINE_BUFFER_SIZE - 1)) != 0
+#error LINE_BUFFER_SIZE must be a power of two up to 256
+#endif
+#define LINE_BUFFER_MASK  (LINE_BUFFER_SIZE - 1)
+
+/*
+ * Single producer (receiver) / single consumer (parser) character ring,
+ * handed out line by line. The producer may run in interrupt context.
+ * Lines that don't fit into the ring are dropped as a whole.
+ */
+
+class ZLineBuffer {
+public:
+  ZLineBuffer() { };
+
+  void          put(char c);                      // producer side
+  bool          getLine(char* dest, int size);    // consumer side, false if there's no complete line
+  byte          getLineCount() { return (byte)(_linesIn - _linesOut); }
+  unsigned long getLinesReceived() { return _linesReceived; }
+  unsigned long getOverflows() { return _overflows; }
+
+private:
+  char          _buffer[LINE_BUFFER_SIZE];
+  volatile byte _head = 0;                        // next free slot, written by the producer
+  volatile byte _tail = 0;                        // oldest character, written by the consumer
+  byte          _lineStart = 0;                   // start of the line being received
+  bool          _discard = false;                 // line being received didn't fit, skip up to its end
+  volatile byte _linesIn = 0;                     // complete lines put, written by the producer
+  volatile byte _linesOut = 0;                    // lines taken, written by the consumer
+  volatile unsigned long _linesReceived = 0;      // statistics, written by the producer
+  volatile unsigned long _overflows = 0;          // statistics (lines dropped), written by the producer
+};
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * SMuFF Firmware
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Module implementing a ring buffer for queued movements
+ */
+
+#include "ZMoveQueue.h"
+
+bool ZMoveQueue::push(MoveBlock* block) {
+  byte head = _head;
+  if(((head + 1) & MOVE_QUEUE_MASK) == _tail)
+    return false;
+  memcpy(&_blocks[head], block, sizeof(MoveBlock));
+  __asm__ __volatile__ ("" ::: "memory");   // block must be complete before it gets published
+  _head = (head + 1) & MOVE_QUEUE_MASK;
+  return true;
+}
+
+void ZMoveQueue::pop() {
+  byte tail = _tail;
+  if(tail != _head)
+    _tail = (tail + 1) & MOVE_QUEUE_MASK;
+}
+
+void ZMoveQueue::clear() {
+  _tail = _head;
+}
+
+bool ZMoveQueue::canBlend(MoveBlock* from, MoveBlock* to) {
+  if(from->axis == -1 || from->axis != to->axis || from->rampSteps == 0 || from->rampSteps != to->rampSteps)
+    return false;
+  if(from->ignoreEndstopFlags != to->ignoreEndstopFlags)
+    return false;
+  return (from->steps[from->axis] < 0) == (to->steps[to->axis] < 0);
+}
+
+/*
+ * Returns the speed (as ramp position) the oldest block may end with,
+ * so that all the blocks queued behind it are still able to stop in time.
+ * Called from the ISR right before the oldest block gets started.
+ */
+long ZMoveQueue::getExitSteps() {
+  long speed = 0;
+  byte tail = _tail;
+  byte count = (_head - tail) & MOVE_QUEUE_MASK;
+  for(int i = count-1; i > 0; i--) {
+    MoveBlock* from = &_blocks[(tail + i - 1) & MOVE_QUEUE_MASK];
+    MoveBlock* to   = &_blocks[(tail + i) & MOVE_QUEUE_MASK];
+    if(!canBlend(from, to)) {
+      speed = 0;
+      continue;
+    }
+    speed += abs(to->steps[to->axis]);
+    if(speed > to->rampSteps)
+      speed = to->rampSteps;
+  }
+  return speed;
+}
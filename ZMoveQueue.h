@@ -0,0 +1,71 @@
+/**
+ * SMuFF Firmware
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <Arduino.h>
+#include "Config.h"
+
+#ifndef _ZMOVEQUEUE_H
+#define _ZMOVEQUEUE_H
+
+#if (MOVE_QUEUE_SIZE & (MOVE_QUEUE_SIZE - 1)) != 0
+#error MOVE_QUEUE_SIZE must be a power of two
+#endif
+#define MOVE_QUEUE_MASK   (MOVE_QUEUE_SIZE - 1)
+
+typedef struct {
+  long    steps[NUM_STEPPERS];          // relative steps per stepper (0 = not moving)
+  byte    axisFlags;                    // _BV(index) for each stepper moving
+  byte    ignoreEndstopFlags;           // _BV(index) for each stepper ignoring its endstop
+  int8_t  axis;                         // index of the only stepper moving, -1 for multi axis moves
+  int8_t  master;                       // index of the stepper with the most steps, clocks all others
+  unsigned int intervalLimit;           // min. interval of the master, so no other stepper exceeds its max. speed
+  long    rampSteps;                    // ramp length of that stepper (0 = no blending possible)
+  bool    prepared;                     // stepper has already been set up through ZStepper::prepareMovement()
+  byte    waitFlags;                    // _BV(index) for each stepper that has to be idle before this move starts (0 = all)
+} MoveBlock;
+
+/*
+ * Single producer (main loop) / single consumer (stepper ISR) queue.
+ * The producer only ever writes _head, the consumer only ever writes _tail,
+ * hence neither side needs to disable interrupts.
+ */
+
+class ZMoveQueue {
+public:
+  ZMoveQueue() { };
+
+  bool          isEmpty() { return _head == _tail; }
+  bool          isFull() { return ((_head + 1) & MOVE_QUEUE_MASK) == _tail; }
+  byte          getCount() { return (_head - _tail) & MOVE_QUEUE_MASK; }
+  bool          push(MoveBlock* block);   // producer side
+  MoveBlock*    peek() { return &_blocks[_tail]; }
+  void          pop();                    // consumer side
+  void          clear();                  // consumer side
+  long          getExitSteps();           // consumer side
+
+private:
+  MoveBlock     _blocks[MOVE_QUEUE_SIZE];
+  volatile byte _head = 0;              // next free slot, written by the producer
+  volatile byte _tail = 0;              // oldest block, written by the consumer
+
+  bool          canBlend(MoveBlock* from, MoveBlock* to);
+};
+
+#endif
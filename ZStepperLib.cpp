@@ -29,7 +29,7 @@ ZStepper::ZStepper() {
   
 }
 
-ZStepper::ZStepper(int number, char* descriptor, int stepPin, int dirPin, int enablePin, float acceleration, unsigned int minStepInterval) {
+ZStepper::ZStepper(int number, const char* descriptor, int stepPin, int dirPin, int enablePin, unsigned int acceleration, unsigned int minStepInterval) {
   _number = number;
   _descriptor = descriptor;
   _stepPin = stepPin;
@@ -40,6 +40,7 @@ ZStepper::ZStepper(int number, char* descriptor, int stepPin, int dirPin, int en
   pinMode(_stepPin,    OUTPUT);
   pinMode(_dirPin,     OUTPUT);
   pinMode(_enablePin,  OUTPUT);
+  buildRampTable();
 }
 
 void ZStepper::defaultStepFunc(void) {
@@ -50,28 +51,129 @@ void ZStepper::defaultStepFunc(void) {
 }
 
 void ZStepper::resetStepper() {
-  _duration = _acceleration;
-  _durationInt = _duration;
+  _rampIndex = 0;
+  _rampPos = 0;
+  _rampC = _rampC0;
+  setInterval(_rampTable[0]);
   _stepCount = 0;
   _movementDone = false;
-  _endstopHit = false;
+  _endstopLatched = false;
+  _endstopHit = readEndstop();
+  _orbitalHit = _endstopHit;
 }
 
-void ZStepper::prepareMovement(long steps, boolean ignoreEndstop = false) {
+void ZStepper::prepareMovement(long steps, boolean ignoreEndstop, long entrySteps, long exitSteps) {
   setDirection(steps < 0 ? CCW : CW);
+  _checkEndstop = (_endstopType == MIN && _dir == CCW) ||
+                  (_endstopType == MAX && _dir == CW) ||
+                  (_endstopType == ORBITAL && _dir == CCW);
   _totalSteps = abs(steps);
-  _accelDistance = _totalSteps >> 5;
-  _stepsAcceleration = (float)((_acceleration - _minStepInterval)+.1) / _accelDistance;
+  // an AVR446 blend continues with the interval the previous movement ended
+  // with, which keeps float math out of the ISR
+  bool carryOver = entrySteps > 0 && _rampValid && _avr446 && _rampPos > 0;
+  unsigned long entryC = _rampC;
+  long entryPos = _rampPos;
+  // this runs in the ISR for queued moves and homing, the table has to be
+  // updated by the main loop (see updateRampTable()); if the settings have
+  // changed since, the move runs on the previous table
+  if(_avr446)
+    entrySteps = carryOver ? entryPos : 0;
+  long rampLength;
+  if(_rampSteps > 0) {
+    // entry and exit speeds are given as ramp position (steps accelerated from standstill)
+    if(entrySteps > _rampSteps)
+      entrySteps = _rampSteps;
+    if(exitSteps > entrySteps + _totalSteps)
+      exitSteps = entrySteps + _totalSteps;
+    if(exitSteps > _rampSteps)
+      exitSteps = _rampSteps;
+    // short moves won't reach max speed and decelerate half way
+    long peak = (entrySteps + _totalSteps + exitSteps) >> 1;
+    if(peak > _rampSteps)
+      peak = _rampSteps;
+    if(peak < entrySteps)
+      peak = entrySteps;
+    _accelDistance = peak - entrySteps;
+    _decelStart = _totalSteps - (peak - exitSteps);
+    rampLength = _rampSteps;
+  }
+  else {
+    entrySteps = exitSteps = 0;
+    _accelDistance = _totalSteps >> 5;
+    _decelStart = _totalSteps - _accelDistance;
+    rampLength = _accelDistance;
+  }
+  _exitSteps = exitSteps;
+  // moves too short for a ramp will run at start speed
+  _rampIndexInc = rampLength > 0 ? (((unsigned long)RAMP_TABLE_SIZE << 16) + rampLength - 1) / rampLength : ((unsigned long)RAMP_TABLE_SIZE << 16);
   _ignoreEndstop = ignoreEndstop;
+  _watchIndex = _endstopType == ORBITAL && (ignoreEndstop || _dir == CW);
+  _seekEndstop = false;
+  _intervalLimit = 0;
   resetStepper();
+  if(carryOver) {
+    _rampPos = entrySteps;
+    _rampC = entryC;
+    if(_rampC < ((unsigned long)_minStepInterval << 8))
+      _rampC = (unsigned long)_minStepInterval << 8;
+    setInterval(_rampC > (0xFFFFUL << 8) ? 0xFFFF : _rampC >> 8);
+  }
+  else if(entrySteps > 0 && !_avr446) {
+    _rampIndex = entrySteps * _rampIndexInc;
+    if(_rampIndex > ((unsigned long)RAMP_TABLE_SIZE << 16))
+      _rampIndex = (unsigned long)RAMP_TABLE_SIZE << 16;
+    setInterval(_rampTable[(uint8_t)(_rampIndex >> 16)]);
+  }
 }
 
-void ZStepper::setEndstop(int pin, int triggerState, EndstopType type) {
+/*
+ * Prepares a movement of at most 'steps' that ends once the endstop gets
+ * triggered, regardless of the endstop direction. After the trigger the
+ * stepper runs on for 'overrun' steps, or for as long as it needs to ramp
+ * down. Just like stopping at the endstop, the trigger point becomes the
+ * origin of the step position. getEndstopLatched() tells whether it was hit.
+ */
+void ZStepper::prepareMovementToEndstop(long steps, long overrun) {
+  updateRampTable();
+  prepareMovement(steps, true);
+  _seekOverrun = overrun;
+  _seekEndstop = true;
+  _watchIndex = false;
+  if(_endstopHit)
+    updateEndstop(true);
+}
+
+/*
+ * Sets up the endstop. If the pin is interrupt capable and an isr is given
+ * (which has to call endstopISR()), the endstop state is maintained by the
+ * pin interrupt. Otherwise the pin gets polled via its port register.
+ */
+void ZStepper::setEndstop(int pin, int triggerState, EndstopType type, void (*isr)()) {
   _endstopPin = pin;
   _endstopState = triggerState;
   _endstopType = type;
-  pinMode(_endstopPin, _endstopType == LOW ? INPUT_PULLUP : INPUT);
-  _endstopHit = digitalRead(_endstopPin) == _endstopState;
+  pinMode(_endstopPin, _endstopState == LOW ? INPUT_PULLUP : INPUT);
+  _endstopPort = portInputRegister(digitalPinToPort(_endstopPin));
+  _endstopMask = digitalPinToBitMask(_endstopPin);
+  _endstopHit = readEndstop();
+  _endstopIsr = false;
+  if(isr != NULL && digitalPinToInterrupt(_endstopPin) != NOT_AN_INTERRUPT) {
+    attachInterrupt(digitalPinToInterrupt(_endstopPin), isr, CHANGE);
+    _endstopIsr = true;
+  }
+}
+
+void ZStepper::endstopISR() {
+  updateEndstop(readEndstop());
+}
+
+void ZStepper::updateEndstop(bool hit) {
+  if(hit && !_endstopLatched) {
+    _endstopLatched = true;
+    _endstopHitTime = micros();
+    _endstopHitPosition = _stepPosition;
+  }
+  _endstopHit = hit;
 }
 
 void ZStepper::setDirection(ZStepper::MoveDirection direction) {
@@ -85,36 +187,174 @@ void ZStepper::setEnabled(boolean state) {
   if(_enablePin != -1) {
     digitalWrite(_enablePin, state ? LOW : HIGH);
     _enabled = state;
+    if(!state)
+      _positionValid = false;         // motor may have moved while disabled
   }
 }
 
+void ZStepper::buildRampTable() {
+  unsigned int minInterval = _minStepInterval > 0 ? _minStepInterval : 1;
+  unsigned int start = _acceleration > minInterval ? _acceleration : minInterval;
+  unsigned long span = start - minInterval;
+  RampMode mode = _accelRate == 0 ? LINEAR : _rampMode;
+  float v0 = (float)STEPPER_TIMER_FREQ / start;
+  float v1 = (float)STEPPER_TIMER_FREQ / minInterval;
+
+  _avr446 = mode == AVR446;
+  if(_avr446) {
+    // ramp starts at standstill, steps slower than the 16 bit timer allows are stretched
+    _rampSteps = (long)(v1*v1 / (2.0 * _accelRate));
+    if(_rampSteps < 1)
+      _rampSteps = 1;
+    _rampC0 = getRampInterval(0);
+    _rampTable[0] = _rampC0 > (0xFFFFUL << 8) ? 0xFFFF : _rampC0 >> 8;
+    _rampValid = true;
+    return;
+  }
+
+  for(int i=0; i <= RAMP_TABLE_SIZE; i++) {
+    float p = (float)i / RAMP_TABLE_SIZE;
+    float v;
+    switch(mode) {
+      case TRAPEZOID:
+        v = sqrt(v0*v0 + (v1*v1 - v0*v0) * p);      // v^2 grows linearly with distance
+        break;
+      case SCURVE:
+        v = v0 + (v1 - v0) * p * p * (3 - 2*p);     // smoothstep, no jumps in acceleration
+        break;
+      default:
+        _rampTable[i] = start - (unsigned int)((span * i) / RAMP_TABLE_SIZE);
+        continue;
+    }
+    unsigned long interval = (unsigned long)((float)STEPPER_TIMER_FREQ / v + .5);
+    _rampTable[i] = interval > start ? start : (interval < minInterval ? minInterval : interval);
+  }
+
+  _rampSteps = 0;
+  if(mode != LINEAR) {
+    _rampSteps = (long)((v1*v1 - v0*v0) / (2.0 * _accelRate));
+    if(mode == SCURVE)
+      _rampSteps += _rampSteps >> 1;                // keep peak acceleration close to the configured one
+    if(_rampSteps < 1)
+      _rampSteps = 1;
+  }
+  _rampValid = true;
+}
+
+unsigned long ZStepper::getRampInterval(long position) {
+  float c;
+  if(position == 0)
+    c = 0.676 * STEPPER_TIMER_FREQ * sqrt(2.0 / _accelRate);   // first interval, corrected as proposed in AVR446
+  else
+    c = (float)STEPPER_TIMER_FREQ / sqrt(2.0 * _accelRate * position);
+  return c >= (float)(AVR446_MAX_INTERVAL >> 8) ? AVR446_MAX_INTERVAL : (unsigned long)(c * 256);
+}
+
+void ZStepper::setMaxStepRate(unsigned long rate) {
+  unsigned long interval = rate > 0 ? STEPPER_TIMER_FREQ / rate : 0xFFFF;
+  setMaxSpeed(interval < 1 ? 1 : (interval > 0xFFFF ? 0xFFFF : interval));
+}
+
+void ZStepper::setIntervalLimit(unsigned int value) {
+  _intervalLimit = value;
+  setInterval(_stepInterval);
+}
+
+/*
+ * Sets the interval for the next step(s). If stepping that fast would exceed
+ * the max. interrupt rate, 2, 4 or 8 steps get emitted in one interrupt instead.
+ */
+void ZStepper::setInterval(unsigned int interval) {
+  if(interval < _intervalLimit)
+    interval = _intervalLimit;
+  _stepInterval = interval;
+  uint8_t shift = 0;
+  while(shift < MAX_STEP_SHIFT && (interval << shift) < _minIsrInterval)
+    shift++;
+  _stepShift = shift;
+  _durationInt = interval << shift;
+}
+
+/*
+ * Lets the current movement end after the given steps, but no sooner
+ * than ramping down from the current speed allows.
+ */
+void ZStepper::stopMovement(long steps) {
+  long rampPos = _avr446 ? _rampPos : (_rampIndexInc > 0 ? _rampIndex / _rampIndexInc : 0);
+  if(steps < rampPos)
+    steps = rampPos;
+  _totalSteps = _stepCount + steps;
+  _accelDistance = -1;
+  _decelStart = _totalSteps - rampPos;
+  _exitSteps = 0;
+  if(_stepCount >= _totalSteps)
+    setMovementDone(true);
+}
+
 void ZStepper::updateAcceleration() {
+  if(_avr446) {
+    updateAccelerationAVR446();
+    return;
+  }
+  unsigned long inc = _rampIndexInc << _stepShift;
+  if(_stepCount <= _accelDistance) {
+    _rampIndex += inc;                  // accelerate
+    if(_rampIndex > ((unsigned long)RAMP_TABLE_SIZE << 16))
+      _rampIndex = (unsigned long)RAMP_TABLE_SIZE << 16;
+  }
+  else if (_stepCount > _decelStart) {
+    if(_rampIndex > inc)                // decelerate
+      _rampIndex -= inc;
+    else
+      _rampIndex = 0;
+  }
+  else
+    return;
+  setInterval(_rampTable[(uint8_t)(_rampIndex >> 16)]);
+}
+
+/*
+ * Integer only interval update, c(n) = c(n-1) - 2*c(n-1)/(4n+1) while accelerating
+ * and the inverse while decelerating. Applied once for all steps of this interrupt,
+ * with rounding, since truncation would add up over long ramps.
+ */
+void ZStepper::updateAccelerationAVR446() {
+  unsigned long k = 1 << _stepShift;
+  unsigned long pos = _rampPos;
+  unsigned long d;
   if(_stepCount <= _accelDistance) {
-    _duration -= _stepsAcceleration;    // accelerate
-    if(_duration <= _minStepInterval)
-      _duration = _minStepInterval;
-    //__debug("durInt: %d, %s", _durationInt,  String(_duration).c_str());
+    d = 4 * pos + 2 * k + 3;
+    _rampC -= (2 * k * _rampC + (d >> 1)) / d;
+    _rampPos = pos + k;
   }
-  else if (_stepCount >= _totalSteps - _accelDistance ) {
-    _duration += _stepsAcceleration;    // decelerate
-    if(_duration >= _acceleration)
-      _duration = _acceleration;
+  else if (_stepCount > _decelStart) {
+    if(pos > k) {
+      d = 4 * pos - 2 * k + 1;
+      _rampC += (2 * k * _rampC + (d >> 1)) / d;
+      if(_rampC > AVR446_MAX_INTERVAL)
+        _rampC = AVR446_MAX_INTERVAL;
+      _rampPos = pos - k;
+    }
+    else {
+      _rampC = _rampC0;
+      _rampPos = 0;
+    }
   }
-  _durationInt = _duration;
+  else
+    return;
+  if(_rampC < ((unsigned long)_minStepInterval << 8))
+    _rampC = (unsigned long)_minStepInterval << 8;
+  setInterval(_rampC > (0xFFFFUL << 8) ? 0xFFFF : _rampC >> 8);
 }
 
-void ZStepper::handleISR() {
+void ZStepper::handleISR(bool accelerate) {
 
   //if(_endstopType == ORBITAL)
   //  __debug("O: %d %d ", _stepCount, _dir);
   
-  if(_endstopType == MIN && _dir == CCW ||
-     _endstopType == MAX && _dir == CW ||
-     _endstopType == ORBITAL && _dir == CCW) {
-     bool hit = digitalRead(_endstopPin)==_endstopState;
-    setEndstopHit(hit);
-  }
-  if(!_ignoreEndstop && _endstopHit && !_movementDone){
+  if((_checkEndstop || _seekEndstop || _watchIndex) && !_endstopIsr)
+    updateEndstop(readEndstop());
+  if(!_ignoreEndstop && _checkEndstop && _endstopHit && !_movementDone){
       setMovementDone(true);
       if(_endstopType == MIN || _endstopType == ORBITAL) {
         setStepPosition(0);
@@ -124,60 +364,156 @@ void ZStepper::handleISR() {
 
     if(endstopFunc != NULL)
       endstopFunc();
+    if(_homingState != HOMING_IDLE)
+      advanceHoming();
     return;
   }
+
+  if(_seekEndstop && _endstopHit && !_movementDone) {
+    _seekEndstop = false;
+    long origin = _endstopType == MAX ? _maxStepCount : 0;
+    if(_endstopType != NONE)
+      setStepPosition(wrapPosition(_stepPosition - _endstopHitPosition + origin));
+    stopMovement(_seekOverrun);
+    if(_movementDone)
+      return;
+  }
   
-  if(_ignoreEndstop && _endstopHit && _endstopType == ORBITAL){
-    setStepPosition(0);
+  if(_watchIndex) {
+    // passing the endstop, position is zero where it gets triggered CCW (index pulse);
+    // CW it triggers at the other edge of the switch, which gets measured on the first
+    // CW pass after homing and is the index position from then on
+    if(_endstopHit && !_orbitalHit) {
+      long index = _dir == CCW ? 0 : _cwIndexPosition;
+      if(index != -1) {
+        _indexDrift = getOrbitalDelta(index, _stepPosition);
+        if(abs(_indexDrift) > _indexTolerance)
+          _positionValid = false;
+        setStepPosition(index);
+      }
+      else if(_positionValid)
+        _cwIndexPosition = _stepPosition;
+    }
+    _orbitalHit = _endstopHit;
   }
   
   if(_maxStepCount != 0 && _dir == CW && _stepCount >= _maxStepCount) {
     setMovementDone(true);
   }
   else if(_stepCount < _totalSteps) {
-    if(stepFunc != NULL)
-      stepFunc();
-     else
-      defaultStepFunc();
-    _stepCount++;
-    setStepPosition(_stepPosition + _dir);
+    if(accelerate && _stepInterval < _peakInterval)
+      _peakInterval = _stepInterval;
+    long steps = 0;
+    bool hit = false;
+    for(uint8_t n = 1 << _stepShift; n > 0 && _stepCount < _totalSteps; n--) {
+      if(stepFunc != NULL)
+        stepFunc();
+       else
+        defaultStepFunc();
+      _stepCount++;
+      steps++;
+      // a trigger within a batch ends the batch, so it gets latched at the step that caused it
+      if(n > 1 && (_checkEndstop || _seekEndstop || _watchIndex) && !_endstopHit && readEndstop()) {
+        hit = true;
+        break;
+      }
+    }
+    long position = _stepPosition + (_dir == CW ? steps : -steps);
+    if(_endstopType == ORBITAL && _maxStepCount > 0) {
+      if(position >= _maxStepCount)
+        position -= _maxStepCount;
+      else if(position < 0)
+        position += _maxStepCount;
+    }
+    setStepPosition(position);
+    if(hit)
+      updateEndstop(true);
     if(_stepCount >= _totalSteps) {
       setMovementDone(true);
       //__debug("handleISR(): %ld / %ld", _stepCount, _totalSteps);
     }
   }
-  updateAcceleration();
+  if(accelerate)
+    updateAcceleration();
+  if(_movementDone && _homingState != HOMING_IDLE)
+    advanceHoming();
+}
+
+/*
+ * Positions of ORBITAL axes are kept within one revolution (_maxStepCount).
+ */
+long ZStepper::wrapPosition(long position) {
+  if(_endstopType != ORBITAL || _maxStepCount <= 0)
+    return position;
+  position %= _maxStepCount;
+  return position < 0 ? position + _maxStepCount : position;
+}
+
+/*
+ * Steps needed to get from one position to another; ORBITAL axes take the
+ * shorter way round.
+ */
+long ZStepper::getOrbitalDelta(long from, long to) {
+  if(_endstopType != ORBITAL || _maxStepCount <= 0)
+    return to - from;
+  long delta = wrapPosition(to - from);
+  return delta > _maxStepCount / 2 ? delta - _maxStepCount : delta;
 }
 
 bool ZStepper::getEndstopHit() {
-  int stat = 0;
-  for(int i=0; i < 5;  i++)
-    stat = digitalRead(_endstopPin);
-  setEndstopHit(stat==_endstopState);
+  if(!_endstopIsr)
+    setEndstopHit(readEndstop());
   return _endstopHit; 
 }
 
+/*
+ * Homing runs as one movement: the ISR switches from the fast approach to the
+ * back-off and the slow re-approach as soon as the previous phase is done.
+ * Speeds are applied as interval limits, so the ramp doesn't need rebuilding.
+ */
 void ZStepper::home() {
 
-  unsigned int curSpeed = getMaxSpeed();
+  unsigned long start = millis();
   long distance = -_maxStepCount;
   if(_endstopPin != -1) {
     distance = -(_maxStepCount*2);
   }
   //__debug("[ZStepper::home] Distance: %d -  max: %d", distance, _maxStepCount);
+  _homingState = HOMING_APPROACH;
+  updateRampTable();
   prepareMovement(distance);
-  //__debug("[ZStepper::home] DONE prepareMovement");
-  if(runAndWaitFunc != NULL)
-    runAndWaitFunc(_number);
-  //__debug("[ZStepper::home] DONE runAndWait");
-  do {
-    prepareMovement(_maxStepCount/30);
-    if(runAndWaitFunc != NULL)
-      runAndWaitFunc(_number);
-  } while(_endstopHit);
-  prepareMovement(-(_maxStepCount));
-  setMaxSpeed(curSpeed*5);
+  setIntervalLimit(_homingSpeed);
   if(runAndWaitFunc != NULL)
     runAndWaitFunc(_number);
-  setMaxSpeed(curSpeed);
+  _homingState = HOMING_IDLE;
+  _homingTime = millis() - start;
+  _positionValid = _endstopPin == -1 || _endstopHit;
+  _indexDrift = 0;
+  _cwIndexPosition = -1;
 }
+
+void ZStepper::advanceHoming() {
+  long bump = _homingBump > 0 ? _homingBump : _maxStepCount/30;
+  switch(_homingState) {
+    case HOMING_APPROACH:
+      if(_endstopPin != -1 && !_endstopHit)
+        break;                          // endstop not found, no use to go on
+      _homingState = HOMING_BACKOFF;
+      prepareMovement(bump);
+      setIntervalLimit(_homingSpeed);
+      return;
+    case HOMING_BACKOFF:
+      _homingState = HOMING_REAPPROACH;
+      prepareMovement(_endstopPin != -1 ? -(bump*2) : -_maxStepCount);
+      if(_homingSpeedSlow > 0)
+        setIntervalLimit(_homingSpeedSlow);
+      else {
+        unsigned long slow = (unsigned long)(_homingSpeed > 0 ? _homingSpeed : _minStepInterval) * 5;
+        setIntervalLimit(slow > 0xFFFF ? 0xFFFF : slow);
+      }
+      return;
+    default:
+      break;
+  }
+  _homingState = HOMING_IDLE;
+}
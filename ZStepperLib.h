@@ -24,6 +24,12 @@
 #ifndef _ZSTEPPER_H
 #define _ZSTEPPER_H
 
+#define RAMP_TABLE_SIZE   32              // number of interval slots in the precomputed acceleration ramp
+#define STEPPER_TIMER_FREQ  F_CPU         // stepper timer ticks per second (timer runs without prescaler)
+#define AVR446_MAX_INTERVAL 0x7FFFFFFUL   // upper limit of the AVR446 interval (24.8), keeps 16*c within 32 bit
+#define MAX_STEP_SHIFT    3               // at most 2^3 steps per interrupt
+#define MIN_ISR_INTERVAL  400             // timer ticks one interrupt takes at most, if the interrupt rate isn't limited
+
 extern void __debug(const char* fmt, ...);
 
 class ZStepper {
@@ -40,11 +46,26 @@ public:
       CCW = -1            // Counter clockwise
     } MoveDirection;
 
+    typedef enum {
+      LINEAR = 0,         // Interval decreases linearly over 1/32 of the move (legacy)
+      TRAPEZOID,          // Constant acceleration, ramp length derived from acceleration rate
+      SCURVE,             // Jerk limited, speed follows a smoothstep curve
+      AVR446              // Constant acceleration from standstill, intervals computed per step (Atmel AVR446)
+    } RampMode;
+
+    typedef enum {
+      HOMING_IDLE = 0,    // not homing
+      HOMING_APPROACH,    // fast move towards the endstop
+      HOMING_BACKOFF,     // short move away from the endstop
+      HOMING_REAPPROACH   // slow move towards the endstop
+    } HomingState;
+
   ZStepper();
-  ZStepper(int number, char* descriptor, int stepPin, int dirPin, int enablePin, float accelaration, unsigned int minStepInterval);
+  ZStepper(int number, const char* descriptor, int stepPin, int dirPin, int enablePin, unsigned int accelaration, unsigned int minStepInterval);
 
-  void prepareMovement(long steps, boolean ignoreEndstop = false);
-  void handleISR();
+  void prepareMovement(long steps, boolean ignoreEndstop = false, long entrySteps = 0, long exitSteps = 0);
+  void prepareMovementToEndstop(long steps, long overrun = 0);
+  void handleISR(bool accelerate = true);
   void home();
 
   void          (*stepFunc)() = NULL;
@@ -52,19 +73,23 @@ public:
   void          (*runAndWaitFunc)(int number) = NULL;
   void          (*runNoWaitFunc)(int number) = NULL;
   void          defaultStepFunc();                    // default step method, uses digitalWrite on _stepPin
+  void          endstopISR();                         // to be called from the endstop pin interrupt
 
-  char*         getDescriptor() { return _descriptor; }
-  void          setDescriptor(char* descriptor) { _descriptor = descriptor; }
+  const char*   getDescriptor() { return _descriptor; }
+  void          setDescriptor(const char* descriptor) { _descriptor = descriptor; }
   MoveDirection getDirection() { return _dir; }
   void          setDirection(MoveDirection newDir);
   bool          getEnabled() { return _enabled; }
   void          setEnabled(bool state);
-  void          setEndstop(int pin, int triggerState, EndstopType type);
+  void          setEndstop(int pin, int triggerState, EndstopType type, void (*isr)() = NULL);
   EndstopType   getEndstopType() { return _endstopType; }
   void          setEndstopType(EndstopType type) { _endstopType = type; }
   int           getEndstopState() { return _endstopState; }
-  void          setEndstopState(int state) { _endstopState = state; }
+  void          setEndstopState(int state) { _endstopState = state; _endstopHit = readEndstop(); }
   bool          getEndstopHit();
+  bool          getEndstopLatched() { return _endstopLatched; }
+  unsigned long getEndstopHitTime() { return _endstopHitTime; }
+  long          getEndstopHitPosition() { return _endstopHitPosition; }
   bool          getEndstopHitAlt() { return _endstopHit; }
   void          setEndstopHit(int state) { _endstopHit = state; }
   int           getEndstopPin() { return _endstopPin; }
@@ -75,21 +100,52 @@ public:
   long          getStepCount() { return _stepCount; }
   void          setStepCount(long count) { _stepCount = count; }
   long          getMaxStepCount() { return _maxStepCount; }
+  unsigned int  getHomingSpeed() { return _homingSpeed; }
+  unsigned int  getHomingSpeedSlow() { return _homingSpeedSlow; }
+  void          setHomingSpeed(unsigned int fast, unsigned int slow) { _homingSpeed = fast; _homingSpeedSlow = slow; }
+  long          getHomingBump() { return _homingBump; }
+  void          setHomingBump(long steps) { _homingBump = steps; }
+  HomingState   getHomingState() { return _homingState; }
+  unsigned long getHomingTime() { return _homingTime; }
   void          setMaxStepCount(long count) { _maxStepCount = count; }
   void          incrementStepCount() { _stepCount++; }
   long          getTotalSteps() { return _totalSteps; }
   void          setTotalSteps(long count) { _totalSteps = count; }
   long          getStepPosition() { return _stepPosition; }
-  void          setStepPosition(long position) { _stepPosition = position; _stepPositionMM = (float)((float)position / _stepsPerMM); }
-  float         getStepPositionMM() { return _stepPositionMM; }
-  void          setStepPositionMM(float position) { _stepPositionMM = position; _stepPosition = (long)(position * _stepsPerMM);}
+  void          setStepPosition(long position) { _stepPosition = position; }
+  float         getStepPositionMM() { return (float)_stepPosition / _stepsPerMM; }
+  void          setStepPositionMM(float position) { _stepPosition = (long)(position * _stepsPerMM);}
   void          incrementStepPosition() { setStepPosition(getStepPosition() + _dir); }
+  long          wrapPosition(long position);
+  bool          isPositionValid() { return _positionValid; }
+  void          setPositionValid(bool state) { _positionValid = state; }
+  long          getIndexDrift() { return _indexDrift; }
+  void          setIndexTolerance(long steps) { _indexTolerance = steps; }
+  long          getOrbitalDelta(long from, long to);
   bool          getMovementDone() { return _movementDone; }
   void          setMovementDone(bool state) { _movementDone = state; }
-  float         getAcceleration() { return _acceleration; }
-  void          setAcceleration(float value) { _acceleration = value; }
+  unsigned int  getAcceleration() { return _acceleration; }
+  void          setAcceleration(unsigned int value) { _acceleration = value; _rampValid = false; }
+  RampMode      getRampMode() { return _rampMode; }
+  void          setRampMode(RampMode mode) { _rampMode = mode; _rampValid = false; }
+  unsigned long getAccelRate() { return _accelRate; }
+  void          setAccelRate(unsigned long rate) { _accelRate = rate; _rampValid = false; }
+  // the ramp table is built with float math, so never from the ISR
+  void          updateRampTable() { if(!_rampValid) buildRampTable(); }
+  bool          isRampValid() { return _rampValid; }
+  long          getRampSteps() { updateRampTable(); return _rampSteps; }
+  long          getExitSteps() { return _exitSteps; }
+  unsigned long getPeakStepRate() { return _peakInterval == 0xFFFF ? 0 : STEPPER_TIMER_FREQ / _peakInterval; }
+  void          resetPeakStepRate() { _peakInterval = 0xFFFF; }
+  void          setIntervalLimit(unsigned int value);
+  unsigned int  getMinIsrInterval() { return _minIsrInterval; }
+  void          setMinIsrInterval(unsigned int value) { _minIsrInterval = value > 0x7FFF ? 0x7FFF : value; }
   unsigned int  getMaxSpeed() { return _minStepInterval; }
-  void          setMaxSpeed(unsigned int value) { _minStepInterval = value; }
+  void          setMaxSpeed(unsigned int value) { _minStepInterval = value; _rampValid = false; }
+  unsigned long getMaxStepRate() { return STEPPER_TIMER_FREQ / (_minStepInterval > 0 ? _minStepInterval : 1); }
+  // highest step rate the interrupt can deliver, batched if the interrupt rate is limited
+  unsigned long getStepRateLimit() { return _minIsrInterval > 0 ? (STEPPER_TIMER_FREQ << MAX_STEP_SHIFT) / _minIsrInterval : STEPPER_TIMER_FREQ / MIN_ISR_INTERVAL; }
+  void          setMaxStepRate(unsigned long rate);
   bool          getInvertDir() { return _invertDir; }
   void          setInvertDir(bool state) { _invertDir = state; }
 
@@ -100,7 +156,7 @@ public:
   
 private:
   int             _number = 0;                  // index of this stepper
-  char*           _descriptor = "";             // display name for this stepper
+  const char*     _descriptor = "";             // display name for this stepper
   int             _stepPin = -1;                // stepping pin
   int             _dirPin = -1;                 // direction pin
   int             _enablePin = -1;              // enable pin
@@ -110,26 +166,70 @@ private:
   bool            _ignoreEndstop = false;       // flag whether or not to ignore endstop trigger
   int             _endstopState = HIGH;         // value for endstop triggered
   EndstopType     _endstopType = NONE;          // type of endstop (MIN, MAX, ORBITAL etc)
+  bool            _orbitalHit = false;          // endstop state of the previous step while passing the endstop of an ORBITAL axis
+  long            _indexTolerance = 0;          // max. drift in steps seen at the endstop of an ORBITAL axis before the position is invalid
+  long            _cwIndexPosition = -1;        // position the endstop of an ORBITAL axis triggers at when passed CW (-1 = not measured since homing)
+  volatile long   _indexDrift = 0;              // position relative to the endstop when it was passed last
+  volatile bool   _positionValid = false;       // false if the axis has to be homed
+  volatile uint8_t* _endstopPort = NULL;        // input register of the endstop pin
+  uint8_t         _endstopMask = 0;             // bit mask of the endstop pin
+  bool            _endstopIsr = false;          // true if _endstopHit is maintained by a pin interrupt
+  bool            _checkEndstop = false;        // true if the current movement runs towards the endstop
+  bool            _watchIndex = false;          // true if the current movement passes the endstop of an ORBITAL axis as index pulse
+  volatile bool   _endstopLatched = false;      // set on the first endstop trigger of the current movement
+  volatile bool   _seekEndstop = false;         // true if the current movement ends when the endstop gets triggered
+  long            _seekOverrun = 0;             // steps to run on after the trigger (at least the ramp down)
+  volatile unsigned long _endstopHitTime = 0;   // micros() of the latched trigger
+  volatile long   _endstopHitPosition = 0;      // step position of the latched trigger
   volatile long   _stepPosition = 0;            // current position of stepper (total of all movements taken so far)
   volatile MoveDirection _dir = CW;             // current direction of movement, used to keep track of position
   volatile long   _totalSteps = 0;              // number of steps requested for current movement
   volatile bool   _movementDone = false;        // true if the current movement has been completed (used by main program to wait for completion)
-  float           _acceleration = 1000;         // acceleration value 
+  unsigned int    _acceleration = 1000;         // acceleration value (interval of the first step)
   unsigned int    _minStepInterval = 100;       // ie. max speed, smaller is faster
   long            _stepCount = 0;               // number of steps completed in current movement
   long            _maxStepCount = 0;            // maximum number of steps
   unsigned int    _stepsPerMM = 0;              // steps needed for one millimeter 
-  float           _stepPositionMM = 0;          // current position of stepper in millimeter
   bool            _invertDir = false;           // stepper direction inversion
 
+  unsigned int    _rampTable[RAMP_TABLE_SIZE+1];// step intervals from _acceleration down to _minStepInterval
+  bool            _rampValid = false;           // false if the ramp table needs to be rebuilt
+  RampMode        _rampMode = LINEAR;           // shape of the acceleration ramp
+  unsigned long   _accelRate = 0;               // acceleration in steps/s^2 (TRAPEZOID and SCURVE only)
+  long            _rampSteps = 0;               // steps needed to reach max speed (0 = scale ramp with move length)
+  long            _exitSteps = 0;               // ramp position the current movement ends with (0 = standstill)
+  unsigned int    _intervalLimit = 0;           // lower limit for the step interval of the current movement
+  unsigned int    _minIsrInterval = 0;          // interrupts closer than this get multiple steps (0 = off)
+  unsigned long   _rampIndexInc = 0;            // ramp table index increment per step (16.16 fixed point)
+  volatile unsigned int _peakInterval = 0xFFFF; // shortest step interval stepped so far (for profiling)
+  unsigned int    _homingSpeed = 0;             // interval for approaching the endstop (0 = max speed)
+  unsigned int    _homingSpeedSlow = 0;         // interval for re-approaching the endstop (0 = 5 times _homingSpeed)
+  long            _homingBump = 0;              // steps to back off from the endstop (0 = 1/30 of _maxStepCount)
+  volatile HomingState _homingState = HOMING_IDLE; // current phase of homing
+  unsigned long   _homingTime = 0;              // duration of the last homing in milliseconds
+  bool            _avr446 = false;              // true if the intervals are computed by the AVR446 recurrence
+  unsigned long   _rampC0 = 0;                  // AVR446: interval of the first step (24.8 fixed point)
+
   // per iteration variables (potentially changed every interrupt)
-  volatile float          _duration;            // current interval length
-  volatile unsigned int   _durationInt;         // above variable truncated
+  volatile unsigned int   _durationInt;         // current interval length (for all steps of this interrupt)
+  volatile unsigned int   _stepInterval;        // current interval length of a single step
+  volatile uint8_t        _stepShift = 0;       // log2 of the number of steps per interrupt
   volatile long           _accelDistance = 0;   // amount of steps for acceleration/deceleration 
-  volatile float          _stepsAcceleration  = 0.0;
+  volatile long           _decelStart = 0;      // step count at which deceleration begins
+  volatile unsigned long  _rampIndex = 0;       // current position in ramp table (16.16 fixed point)
+  volatile long           _rampPos = 0;         // AVR446: current ramp position (steps accelerated from standstill)
+  volatile unsigned long  _rampC = 0;           // AVR446: current interval, not limited to 16 bit (24.8 fixed point)
 
   void resetStepper();                          // method to reset work params
+  bool readEndstop() { return _endstopPort != NULL && ((*_endstopPort & _endstopMask) != 0) == (_endstopState != LOW); }
+  void updateEndstop(bool hit);                 // method to set the endstop state and latch the trigger
+  void buildRampTable();                        // method to precompute the ramp intervals
+  void setInterval(unsigned int interval);      // method to set the interval and steps per interrupt
   void updateAcceleration();
+  void updateAccelerationAVR446();
+  void advanceHoming();                         // method to start the next homing phase
+  void stopMovement(long steps);                // method to end the current movement after the given steps
+  unsigned long getRampInterval(long position); // AVR446: interval at the given ramp position (24.8 fixed point)
 };
 
 #endif
@@ -23,8 +23,14 @@
  
 #include "ZTimerLib.h"
 
-void ZTimer::setupTimer(IsrTimer timer, TimerPrescaler prescaler) {
+/*
+ * Sets up the timer either in CTC mode (counter gets reset on each interrupt) or
+ * free-running (normal mode), where each compare value is the previous one plus
+ * the interval, so the time spent in the ISR doesn't add up to the periods.
+ */
+void ZTimer::setupTimer(IsrTimer timer, TimerPrescaler prescaler, bool freeRunning) {
   _timer = timer;
+  _freeRunning = freeRunning;
 
   stopTimer();
   noInterrupts();
@@ -32,25 +38,30 @@ void ZTimer::setupTimer(IsrTimer timer, TimerPrescaler prescaler) {
     case TIMER1:
       TCCR1A = 0;
       TCCR1B = prescaler;
-      TCCR1B |= _BV(WGM12);                     // CTC mode
+      if(!_freeRunning)
+        TCCR1B |= _BV(WGM12);                   // CTC mode
       break;
     case TIMER3:
       TCCR3A = 0;
       TCCR3B = prescaler;
-      TCCR3B |= _BV(WGM32);                     // CTC mode
+      if(!_freeRunning)
+        TCCR3B |= _BV(WGM32);                   // CTC mode
       break;
     case TIMER4:
       TCCR4A = 0;
       TCCR4B = prescaler;
-      TCCR4B |= _BV(WGM42);                     // CTC mode
+      if(!_freeRunning)
+        TCCR4B |= _BV(WGM42);                   // CTC mode
       break;
     case TIMER5:
       TCCR5A = 0;
       TCCR5B = prescaler;
-      TCCR5B |= _BV(WGM52);                     // CTC mode
+      if(!_freeRunning)
+        TCCR5B |= _BV(WGM52);                   // CTC mode
       break;
   }
  
+  _deadline = getTCNTx();
   setNextInterruptInterval(1000);
   interrupts();
 }
@@ -85,8 +96,26 @@ void ZTimer::setupTimerHook(void (*function)(void))
   }
 }
 
-void ZTimer::setNextInterruptInterval(unsigned int interval) {
+void ZTimer::setNextInterruptInterval(uint16_t interval) {
+  _interval = interval;
+  if(_freeRunning) {
+    if(!isRunning())
+      _deadline = getTCNTx();                   // schedule starts now after the timer has been stopped
+    uint16_t last = _deadline;
+    _deadline = last + interval;
+    setOCRxA(_deadline);
+    uint16_t elapsed = getTCNTx() - last;
+    if((unsigned long)elapsed + 32 > interval) {
+      // deadline has passed already (or is too close), fire as soon as possible but keep the schedule
+      setOCRxA(last + elapsed + 32);
+      if(elapsed >= interval)
+        _missedDeadlines++;
+    }
+    startTimer();
+    return;
+  }
   stopTimer();
+  _base += getTCNTx();
   switch(_timer) {
     case TIMER1: OCR1A = interval; TCNT1 = 0; break;
     case TIMER3: OCR3A = interval; TCNT3 = 0; break;
@@ -96,6 +125,41 @@ void ZTimer::setNextInterruptInterval(unsigned int interval) {
   startTimer();
 }
 
+/*
+ * Starts/stops measuring the actual period between two interrupts against the
+ * commanded interval. measureInterval() has to be called first thing in the ISR.
+ */
+void ZTimer::setMeasurement(bool state) {
+  noInterrupts();
+  _measure = state;
+  _measureValid = false;
+  if(state) {
+    _samples = 0;
+    _deviationSum = 0;
+    _deviationMin = 0x7FFF;
+    _deviationMax = -0x7FFF;
+    _missedDeadlines = 0;
+  }
+  interrupts();
+}
+
+void ZTimer::measureInterval() {
+  if(!_measure)
+    return;
+  uint16_t now = getTimestamp();
+  if(_measureValid) {
+    int deviation = (int16_t)(now - _lastTimestamp - _interval);
+    if(deviation < _deviationMin)
+      _deviationMin = deviation;
+    if(deviation > _deviationMax)
+      _deviationMax = deviation;
+    _deviationSum += deviation;
+    _samples++;
+  }
+  _lastTimestamp = now;
+  _measureValid = true;
+}
+
 unsigned int ZTimer::getOCRxA() {
   switch(_timer) {
     case TIMER1: return OCR1A;
@@ -103,6 +167,7 @@ unsigned int ZTimer::getOCRxA() {
     case TIMER4: return OCR4A;
     case TIMER5: return OCR5A;
   }
+  return 0;
 }
 
 void ZTimer::setOCRxA(unsigned int value) {
@@ -114,6 +179,16 @@ void ZTimer::setOCRxA(unsigned int value) {
   }
 }
 
+unsigned int ZTimer::getTCNTx() {
+  switch(_timer) {
+    case TIMER1: return TCNT1;
+    case TIMER3: return TCNT3;
+    case TIMER4: return TCNT4;
+    case TIMER5: return TCNT5;
+  }
+  return 0;
+}
+
 void ZTimer::setTCNTx(unsigned int value) {
   switch(_timer) {
     case TIMER1: TCNT1 = value; break;
@@ -132,11 +207,25 @@ void ZTimer::startTimer() {
   }
 }
 
+bool ZTimer::isRunning() {
+  switch(_timer) {
+    case TIMER1: return (TIMSK1 & _BV(OCIE1A)) != 0;
+    case TIMER3: return (TIMSK3 & _BV(OCIE3A)) != 0;
+    case TIMER4: return (TIMSK4 & _BV(OCIE4A)) != 0;
+    case TIMER5: return (TIMSK5 & _BV(OCIE5A)) != 0;
+  }
+  return false;
+}
+
+/*
+ * Also discards a compare match that is still pending, so a restarted
+ * schedule doesn't fire on the match of the previous one.
+ */
 void ZTimer::stopTimer() {
   switch(_timer) {
-    case TIMER1: TIMSK1 &= ~_BV(OCIE1A); break;
-    case TIMER3: TIMSK3 &= ~_BV(OCIE3A); break;
-    case TIMER4: TIMSK4 &= ~_BV(OCIE4A); break;
-    case TIMER5: TIMSK5 &= ~_BV(OCIE5A); break;
+    case TIMER1: TIMSK1 &= ~_BV(OCIE1A); TIFR1 = _BV(OCF1A); break;
+    case TIMER3: TIMSK3 &= ~_BV(OCIE3A); TIFR3 = _BV(OCF3A); break;
+    case TIMER4: TIMSK4 &= ~_BV(OCIE4A); TIFR4 = _BV(OCF4A); break;
+    case TIMER5: TIMSK5 &= ~_BV(OCIE5A); TIFR5 = _BV(OCF5A); break;
   }
 }
@@ -50,17 +50,47 @@ public:
 
     ZTimer() { };
     
-    void           setupTimer(IsrTimer timer, TimerPrescaler prescaler);
+    void           setupTimer(IsrTimer timer, TimerPrescaler prescaler, bool freeRunning = false);
     void           setupTimerHook(void (*function)(void));
-    void           setNextInterruptInterval(unsigned int interval);
+    void           setNextInterruptInterval(uint16_t interval);
     unsigned int   getOCRxA();
     void           setOCRxA(unsigned int value);
+    unsigned int   getTCNTx();
     void           setTCNTx(unsigned int value);
     void           startTimer();
     void           stopTimer();
+    bool           isRunning();
+    bool           isFreeRunning() { return _freeRunning; }
+    uint16_t       getInterval() { return _interval; }
+    uint16_t       getTimestamp() { return _base + getTCNTx(); }
+    unsigned long  getMissedDeadlines() { return _missedDeadlines; }
+    void           resetMissedDeadlines() { _missedDeadlines = 0; }
+
+    void           setMeasurement(bool state);
+    bool           getMeasurement() { return _measure; }
+    void           measureInterval();
+    unsigned long  getSamples() { return _samples; }
+    int            getDeviationMin() { return _samples > 0 ? _deviationMin : 0; }
+    int            getDeviationMax() { return _samples > 0 ? _deviationMax : 0; }
+    int            getDeviationAvg() { return _samples > 0 ? _deviationSum / (long)_samples : 0; }
 
 private:
     IsrTimer      _timer;
+    bool          _freeRunning = false;         // counter isn't reset on interrupt, compare values are absolute deadlines
+    // counter values are uint16_t, so they wrap like the 16 bit timer (also off-target)
+    volatile uint16_t      _interval = 0;       // interval of the current period
+    volatile uint16_t      _deadline = 0;       // counter value the current period ends (free-running only)
+    volatile uint16_t      _base = 0;           // ticks counted before the last counter reset (CTC only)
+    volatile unsigned long _missedDeadlines = 0;// deadlines already passed when they were set
+    
+    // step period measurement (commanded vs. actual)
+    volatile bool          _measure = false;    // measurement running
+    volatile bool          _measureValid = false; // _lastTimestamp is valid
+    volatile uint16_t      _lastTimestamp = 0;  // timestamp of the previous interrupt
+    volatile unsigned long _samples = 0;        // number of periods measured
+    volatile long          _deviationSum = 0;   // sum of all deviations (actual - commanded) in ticks
+    volatile int           _deviationMin = 0;   // smallest deviation in ticks
+    volatile int           _deviationMax = 0;   // biggest deviation in ticks
 };
 
 #endif
@@ -0,0 +1,99 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include "Firmware.h"
+#include "Machine.h"
+
+#ifndef FIRMWARE_DIR
+#define FIRMWARE_DIR ".."
+#endif
+
+namespace Firmware {
+
+std::string readConfig() {
+  std::string config;
+  FILE* f = fopen(FIRMWARE_DIR "/SMUFF.cfg", "rb");
+  if(f == NULL) {
+    fprintf(stderr, "can't read %s/SMUFF.cfg\n", FIRMWARE_DIR);
+    exit(2);
+  }
+  char buf[512];
+  size_t n;
+  while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    config.append(buf, n);
+  fclose(f);
+  return config;
+}
+
+/*
+ * Replaces the value of a key, optionally within a section ("Feeder" etc.).
+ */
+void setConfigValue(std::string& config, const char* section, const char* key, const char* value) {
+  size_t from = 0;
+  if(section != NULL)
+    from = config.find(std::string("\"") + section + "\"");
+  size_t pos = from == std::string::npos ? from : config.find(std::string("\"") + key + "\"", from);
+  if(pos == std::string::npos) {
+    fprintf(stderr, "config has no key %s\n", key);
+    exit(2);
+  }
+  size_t begin = config.find(':', pos) + 1;
+  size_t end = config.find_first_of(",}\r\n", begin);
+  config.replace(begin, end - begin, std::string(" ") + value);
+}
+
+void boot(const std::string& config) {
+  // a busy loop that doesn't call into the core never lets virtual time pass
+  alarm(300);
+  Machine::begin();
+  SD.clear();
+  SD.addFile(CONFIG_FILE, config);
+  EEPROM.clear();
+  // powered off at the positions it has saved
+  for(int i = 0; i < NUM_STEPPERS; i++)
+    EEPROM.put(i * sizeof(long), Machine::getPosition(i));
+  Serial.clearOutput();
+  setup();
+}
+
+bool isIdle() {
+  return Serial.isIdle() && Serial2.isIdle() && commandQueue.isEmpty() && !parserBusy && isMoveQueueIdle();
+}
+
+bool runUntilIdle(VirtualAvr::Cycles timeout) {
+  VirtualAvr::Cycles end = VirtualAvr::now() + timeout;
+  do {
+    loop();
+    if(VirtualAvr::now() > end)
+      return false;
+  } while(!isIdle());
+  return true;
+}
+
+int countResponses(const char* response) {
+  const std::string& out = Serial.output();
+  int n = 0;
+  for(size_t pos = 0; (pos = out.find(response, pos)) != std::string::npos; pos += strlen(response))
+    n++;
+  return n;
+}
+
+}
@@ -0,0 +1,50 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Runs the firmware (setup() and loop()) on the simulated machine.
+ */
+
+#ifndef _FIRMWARE_H
+#define _FIRMWARE_H
+
+#include <string>
+#include "VirtualAvr.h"
+#include "SMuFF.h"
+#include "ZStepperLib.h"
+#include "ZTimerLib.h"
+#include "ZCommandQueue.h"
+
+extern ZStepper       steppers[NUM_STEPPERS];
+extern ZTimer         stepperTimer;
+extern ZTimer         feederTimer;
+extern ZCommandQueue  commandQueue;
+extern void           setup();
+extern void           loop();
+
+namespace Firmware {
+  std::string readConfig();                     // SMUFF.cfg of the firmware
+  void    setConfigValue(std::string& config, const char* section, const char* key, const char* value);
+  void    boot(const std::string& config);      // resets the machine and runs setup()
+  bool    isIdle();                             // nothing received, queued or moving
+  bool    runUntilIdle(VirtualAvr::Cycles timeout);   // runs loop(), false on timeout
+  int     countResponses(const char* response); // occurrences in the output of Serial
+}
+
+#endif
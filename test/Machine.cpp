@@ -0,0 +1,139 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "Machine.h"
+#include "SMuFF.h"
+
+namespace Machine {
+
+struct Axis {
+  int           stepPin;
+  int           dirPin;
+  int           enablePin;
+  int           endstopPin;
+  long          position;
+  unsigned long steps;
+};
+
+static Axis axes[NUM_STEPPERS] = {
+  { X_STEP_PIN, X_DIR_PIN, X_ENABLE_PIN, X_END_PIN },
+  { Y_STEP_PIN, Y_DIR_PIN, Y_ENABLE_PIN, Y_END_PIN },
+  { Z_STEP_PIN, Z_DIR_PIN, Z_ENABLE_PIN, Z_END_PIN },
+};
+static long               indexWidth = 20;
+static bool               recording = false;
+static std::vector<Step>  steps;
+
+static bool isTriggered(int axis) {
+  long pos = axes[axis].position;
+  switch(axis) {
+    case SELECTOR:
+      return pos <= 0;
+    case REVOLVER: {
+      long rev = smuffConfig.stepsPerRevolution_Y > 0 ? smuffConfig.stepsPerRevolution_Y : 9600;
+      pos %= rev;
+      if(pos < 0)
+        pos += rev;
+      return pos < indexWidth;
+    }
+    default:
+      return pos >= 0;
+  }
+}
+
+static int triggerState(int axis) {
+  switch(axis) {
+    case SELECTOR:  return smuffConfig.endstopTrigger_X;
+    case REVOLVER:  return smuffConfig.endstopTrigger_Y;
+    default:        return smuffConfig.endstopTrigger_Z;
+  }
+}
+
+static bool isInverted(int axis) {
+  switch(axis) {
+    case SELECTOR:  return smuffConfig.invertDir_X;
+    case REVOLVER:  return smuffConfig.invertDir_Y;
+    default:        return smuffConfig.invertDir_Z;
+  }
+}
+
+static void updateEndstop(int axis) {
+  int state = triggerState(axis);
+  VirtualAvr::setInput(axes[axis].endstopPin, isTriggered(axis) ? state : !state);
+}
+
+static void onPinChange(int pin, int level, VirtualAvr::Cycles when) {
+  if(!level)
+    return;
+  for(int i = 0; i < NUM_STEPPERS; i++) {
+    Axis& axis = axes[i];
+    if(pin != axis.stepPin)
+      continue;
+    // direction pin is high for CCW (i.e. towards the endstop) unless inverted
+    bool ccw = VirtualAvr::getOutput(axis.dirPin) != isInverted(i);
+    axis.position += ccw ? -1 : 1;
+    axis.steps++;
+    if(recording)
+      steps.push_back({ i, when, axis.position });
+    updateEndstop(i);
+  }
+}
+
+void begin() {
+  VirtualAvr::reset();
+  VirtualAvr::setPinListener(onPinChange);
+  setPosition(SELECTOR, 4000);
+  setPosition(REVOLVER, 2500);
+  setPosition(FEEDER, -4000);
+  for(int i = 0; i < NUM_STEPPERS; i++)
+    axes[i].steps = 0;
+  steps.clear();
+}
+
+void setPosition(int axis, long position) {
+  axes[axis].position = position;
+  updateEndstop(axis);
+}
+
+long getPosition(int axis) {
+  return axes[axis].position;
+}
+
+void setRevolverIndexWidth(long width) {
+  indexWidth = width;
+  updateEndstop(REVOLVER);
+}
+
+unsigned long getStepCount(int axis) {
+  return axes[axis].steps;
+}
+
+void setRecording(bool state) {
+  recording = state;
+}
+
+const std::vector<Step>& getSteps() {
+  return steps;
+}
+
+void clearSteps() {
+  steps.clear();
+}
+
+}
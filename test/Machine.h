@@ -0,0 +1,54 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Model of the SMuFF mechanics driven by the simulated step, direction and
+ * enable pins. It feeds the endstop inputs back and records when each axis
+ * has stepped.
+ *
+ *  - Selector: endstop triggered at position 0 and below
+ *  - Revolver: endstop triggered for the first steps of each revolution
+ *  - Feeder:   position is the filament tip, the endstop is triggered
+ *              while the tip is at or beyond the sensor (position 0)
+ */
+
+#ifndef _MACHINE_H
+#define _MACHINE_H
+
+#include <vector>
+#include "VirtualAvr.h"
+
+namespace Machine {
+  struct Step {
+    int                 axis;
+    VirtualAvr::Cycles  when;
+    long                position;
+  };
+
+  void    begin();                              // resets the clock and the axes, connects to the pins
+  void    setPosition(int axis, long position);
+  long    getPosition(int axis);
+  void    setRevolverIndexWidth(long steps);    // steps the revolver endstop stays triggered
+  unsigned long getStepCount(int axis);
+  void    setRecording(bool state);             // record each step with its timestamp
+  const std::vector<Step>& getSteps();
+  void    clearSteps();
+}
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Cycles per lookup of findGCodeFunc() over the full G and M command set,
+ * compared to walking the table like parse_G() and parse_M() did before.
+ *
+ *   bench_dispatch [rounds]
+ *
+ * Each round looks up every known code once and as many unknown codes.
+ * Fails if the two lookups don't find the same handlers for all codes
+ * from -1 to 2100.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Gcodes.h"
+
+extern const GCodeFunctions gCodeFuncsM[];
+extern const GCodeFunctions gCodeFuncsG[];
+extern const int gCodeFuncsMCount;
+extern const int gCodeFuncsGCount;
+
+#define MAX_CODE  2100
+
+static unsigned long long cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static GCodeFunc linearGCodeFunc(const GCodeFunctions* table, int count, int code) {
+  for(int i=0; i < count; i++) {
+    if((int)pgm_read_word(&table[i].code) == code)
+      return (GCodeFunc)pgm_read_ptr(&table[i].func);
+  }
+  return NULL;
+}
+
+typedef GCodeFunc (*Lookup)(const GCodeFunctions* table, int count, int code);
+
+typedef struct {
+  const char*             name;
+  const GCodeFunctions*   table;
+  int                     count;
+} Table;
+
+static int* codes = NULL;
+static int numCodes = 0;
+
+/*
+ * Every code of the table, and the one right after it if that's unknown.
+ */
+static void makeCodes(const Table& table) {
+  free(codes);
+  codes = (int*)malloc(sizeof(int) * table.count * 2);
+  numCodes = 0;
+  for(int i=0; i < table.count; i++)
+    codes[numCodes++] = table.table[i].code;
+  for(int i=0; i < table.count; i++) {
+    int code = table.table[i].code + 1;
+    if(i + 1 >= table.count || table.table[i + 1].code != code)
+      codes[numCodes++] = code;
+  }
+}
+
+static double run(Lookup lookup, const Table& table, unsigned long rounds) {
+  volatile GCodeFunc found;
+  unsigned long long start = cycles();
+  for(unsigned long n=0; n < rounds; n++) {
+    for(int i=0; i < numCodes; i++)
+      found = lookup(table.table, table.count, codes[i]);
+  }
+  return (double)(cycles() - start) / rounds / numCodes;
+}
+
+int main(int argc, char** argv) {
+  unsigned long rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+  if(rounds == 0) {
+    fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+    return 2;
+  }
+  Table tables[] = {
+    { "G", gCodeFuncsG, gCodeFuncsGCount },
+    { "M", gCodeFuncsM, gCodeFuncsMCount },
+  };
+
+  int errors = 0;
+  printf("cycles per lookup, %lu rounds\n", rounds);
+  printf("%-6s %8s %8s %8s %8s\n", "table", "entries", "linear", "binary", "ratio");
+  for(unsigned t=0; t < sizeof(tables)/sizeof(tables[0]); t++) {
+    const Table& table = tables[t];
+    for(int code = -1; code <= MAX_CODE; code++) {
+      if(findGCodeFunc(table.table, table.count, code) != linearGCodeFunc(table.table, table.count, code)) {
+        printf("FAIL: %s%d found a different handler\n", table.name, code);
+        errors++;
+      }
+    }
+    makeCodes(table);
+    double linear = run(linearGCodeFunc, table, rounds);
+    double binary = run(findGCodeFunc, table, rounds);
+    printf("%-6s %8d %8.1f %8.1f %8.2f\n", table.name, table.count, linear, binary, linear / binary);
+  }
+  free(codes);
+  return errors > 0 ? 1 : 0;
+}
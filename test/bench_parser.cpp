@@ -0,0 +1,185 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Lines per second and heap allocations per line of tokenizeGcode(),
+ * compared to the String based parser it replaced (namespace Legacy below,
+ * copied from that version).
+ *
+ *   bench_parser [lines]
+ *
+ * Both parsers take a line apart and read the parameters a handler would
+ * ask for; finding and calling the handler isn't part of it (see
+ * bench_dispatch). The allocations are the ones String makes, on the
+ * ATmega each of them is a malloc() on an 8 KB heap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "Gcodes.h"
+
+// typical traffic, from a host with line numbers and checksums and from the console
+static const char* lines[] = {
+  "N12 T3*87\n",
+  "N13 G1 Y90 F1200*21\n",
+  "N14 M119*18\n",
+  "T1 S1\r\n",
+  "G1 X30 Y180\n",
+  "M115\n",
+  "M203 X1000 Y2000 Z500\n",
+  "M700 S\"PLA red\"\n",
+  "G28 ; home all\n",
+  "M201 X100 Y1500 Z200\n",
+  "G1 X1E3 F600\n",
+  NULL
+};
+
+// parameters read by the handlers
+static const char paramLetters[] = "SXYZF";
+
+namespace Legacy {
+
+  int getParam(String buf, const char* token) {
+    int pos = buf.indexOf(token);
+    if(pos != -1) {
+      if(buf.charAt(pos+1)=='-') {
+        int val = buf.substring(pos+2).toInt();
+        return 0-val;
+      }
+      return buf.substring(pos+1).toInt();
+    }
+    else
+      return -1;
+  }
+
+  // what parse_G(), parse_M() and parse_T() did before calling the handler
+  long parseCommand(String buf, const char* format) {
+    if(buf.length()==0)
+      return 0;
+    int code = buf.toInt();
+    char msg[10];
+    sprintf(msg, format, code);
+    int ofs = String(msg).length()-2;
+    String params = buf.substring(ofs);
+    long sum = code;
+    char token[2] = { 0, 0 };
+    for(const char* letter = paramLetters; *letter; letter++) {
+      token[0] = *letter;
+      sum += getParam(params, token);
+    }
+    return sum;
+  }
+
+  long parseGcode(String serialBuffer) {
+    serialBuffer.replace(" ","");
+    serialBuffer.replace("\r","");
+    serialBuffer.replace("\n","");
+
+    if(serialBuffer.length()==0)
+      return 0;
+
+    String line = String(serialBuffer);
+    int pos;
+    if((pos = line.lastIndexOf("*")) > -1) {
+      line = line.substring(0, pos);
+    }
+    if((pos = line.lastIndexOf(";")) > -1) {
+      if(pos==0)
+        return 0;
+      line = line.substring(0, pos);
+    }
+    if(line.startsWith("N")) {
+      char ln[15];
+      if((currentLine = getParam(line, "N")) != -1) {
+        sprintf(ln, "%d", currentLine);
+        line = line.substring(strlen(ln)+1);
+      }
+    }
+    if(line.startsWith("G"))
+      return parseCommand(line.substring(1), "G%d\n");
+    else if(line.startsWith("M"))
+      return parseCommand(line.substring(1), "M%d\n");
+    else if(line.startsWith("T"))
+      return parseCommand(line.substring(1), "T%d\n");
+    return 0;
+  }
+}
+
+static long parseGcode(const char* received) {
+  char line[MAX_GCODE_LENGTH];
+  strlcpy(line, received, sizeof(line));
+  GCodeLine gcode;
+  if(!tokenizeGcode(line, &gcode))
+    return 0;
+  if(gcode.lineNumber != -1)
+    currentLine = gcode.lineNumber;
+  char msg[10];
+  sprintf(msg, "%c%d\n", gcode.cmd, gcode.code);
+  long sum = gcode.code;
+  for(const char* letter = paramLetters; *letter; letter++) {
+    int value;
+    sum += getParam(&gcode.params, *letter, &value) ? value : -1;
+  }
+  return sum;
+}
+
+typedef struct {
+  double        linesPerSecond;
+  double        allocationsPerLine;
+  long          checksum;
+} Result;
+
+template<typename Parser> static Result run(Parser parse, unsigned long count) {
+  Result result = { 0, 0, 0 };
+  unsigned long allocations = mockStringAllocations;
+  auto start = std::chrono::steady_clock::now();
+  for(unsigned long i=0; i < count; ) {
+    for(const char** line = lines; *line != NULL && i < count; line++, i++)
+      result.checksum += parse(*line);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  result.linesPerSecond = count / elapsed.count();
+  result.allocationsPerLine = (double)(mockStringAllocations - allocations) / count;
+  return result;
+}
+
+int main(int argc, char** argv) {
+  unsigned long count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  if(count == 0) {
+    fprintf(stderr, "usage: %s [lines]\n", argv[0]);
+    return 2;
+  }
+
+  Result legacy = run([](const char* line) { return Legacy::parseGcode(String(line)); }, count);
+  Result current = run(parseGcode, count);
+
+  printf("%lu lines\n", count);
+  printf("%-8s %14s %14s\n", "parser", "lines/s", "allocs/line");
+  printf("%-8s %14.0f %14.2f\n", "legacy", legacy.linesPerSecond, legacy.allocationsPerLine);
+  printf("%-8s %14.0f %14.2f\n", "current", current.linesPerSecond, current.allocationsPerLine);
+  printf("speedup %.1fx\n", current.linesPerSecond / legacy.linesPerSecond);
+  // both parsers have to agree on what they read
+  if(legacy.checksum != current.checksum) {
+    printf("FAIL: results differ (%ld, %ld)\n", legacy.checksum, current.checksum);
+    return 1;
+  }
+  return 0;
+}
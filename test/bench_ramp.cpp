@@ -0,0 +1,217 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Cycles per step spent in ZStepper::handleISR(), for each ramp mode,
+ * compared to the float ramp the stepper library used before the ramp
+ * table (LegacyStepper below, copied from that version).
+ *
+ *   bench_ramp [steps]
+ *
+ * The cycles are the ones of the host (TSC), which has an FPU. On the host
+ * the table path is slower than the float path, it does more per step
+ * (step batching, endstop latching, peak rate, orbital wrap). The figures
+ * don't tell anything about the ATmega, where float math runs in libgcc;
+ * cycle counts for the target haven't been taken.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "ZStepperLib.h"
+
+#define REPEAT  20
+
+static unsigned long long cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void noStep() {
+  asm volatile("" ::: "memory");
+}
+
+/*
+ * The ramp path of ZStepper before the ramp table: one float add and
+ * compare per step in updateAcceleration() and a float divide for the
+ * position in millimeter.
+ */
+class LegacyStepper {
+public:
+  typedef enum { NONE = -1, MIN, MAX, ORBITAL } EndstopType;
+  typedef enum { CW = 1, CCW = -1 } MoveDirection;
+
+  LegacyStepper(float acceleration, unsigned int minStepInterval, unsigned int stepsPerMM) {
+    _acceleration = acceleration;
+    _minStepInterval = minStepInterval;
+    _stepsPerMM = stepsPerMM;
+  }
+
+  void (*stepFunc)() = NULL;
+
+  bool getMovementDone() { return _movementDone; }
+  void setMovementDone(bool state) { _movementDone = state; }
+  void setStepPosition(long position) { _stepPosition = position; _stepPositionMM = (float)((float)position / _stepsPerMM); }
+
+  void prepareMovement(long steps) {
+    _dir = steps < 0 ? CCW : CW;
+    _totalSteps = abs(steps);
+    _accelDistance = _totalSteps >> 5;
+    _stepsAcceleration = (float)((_acceleration - _minStepInterval)+.1) / _accelDistance;
+    _duration = _acceleration;
+    _durationInt = _duration;
+    _stepCount = 0;
+    _movementDone = false;
+    _endstopHit = false;
+  }
+
+  void updateAcceleration() {
+    if(_stepCount <= _accelDistance) {
+      _duration -= _stepsAcceleration;    // accelerate
+      if(_duration <= _minStepInterval)
+        _duration = _minStepInterval;
+    }
+    else if (_stepCount >= _totalSteps - _accelDistance ) {
+      _duration += _stepsAcceleration;    // decelerate
+      if(_duration >= _acceleration)
+        _duration = _acceleration;
+    }
+    _durationInt = _duration;
+  }
+
+  void handleISR() {
+    if(_endstopType == MIN && _dir == CCW ||
+       _endstopType == MAX && _dir == CW ||
+       _endstopType == ORBITAL && _dir == CCW) {
+      _endstopHit = digitalRead(_endstopPin)==_endstopState;
+    }
+    if(!_ignoreEndstop && _endstopHit && !_movementDone){
+      setMovementDone(true);
+      setStepPosition(0);
+      return;
+    }
+    if(_maxStepCount != 0 && _dir == CW && _stepCount >= _maxStepCount) {
+      setMovementDone(true);
+    }
+    else if(_stepCount < _totalSteps) {
+      stepFunc();
+      _stepCount++;
+      setStepPosition(_stepPosition + _dir);
+      if(_stepCount >= _totalSteps) {
+        setMovementDone(true);
+      }
+    }
+    updateAcceleration();
+  }
+
+private:
+  int             _endstopPin = -1;
+  volatile bool   _endstopHit = false;
+  bool            _ignoreEndstop = false;
+  int             _endstopState = HIGH;
+  EndstopType     _endstopType = NONE;
+  volatile long   _stepPosition = 0;
+  volatile MoveDirection _dir = CW;
+  volatile long   _totalSteps = 0;
+  volatile bool   _movementDone = false;
+  float           _acceleration = 1000;
+  unsigned int    _minStepInterval = 100;
+  long            _stepCount = 0;
+  long            _maxStepCount = 0;
+  unsigned int    _stepsPerMM = 0;
+  float           _stepPositionMM = 0;
+
+  volatile float          _duration;
+  volatile unsigned int   _durationInt;
+  volatile long           _accelDistance = 0;
+  volatile float          _stepsAcceleration  = 0.0;
+};
+
+/*
+ * Runs a movement of the given steps and returns the cycles per step of
+ * the fastest of REPEAT runs.
+ */
+template<class Stepper> static double runMove(Stepper& stepper, long steps) {
+  unsigned long long best = ~0ULL;
+  for(int i=0; i < REPEAT; i++) {
+    stepper.prepareMovement(i & 1 ? -steps : steps);
+    unsigned long long start = cycles();
+    while(!stepper.getMovementDone())
+      stepper.handleISR();
+    unsigned long long elapsed = cycles() - start;
+    if(elapsed < best)
+      best = elapsed;
+  }
+  return (double)best / steps;
+}
+
+typedef struct {
+  const char*       name;
+  ZStepper::RampMode mode;
+  unsigned int      acceleration;       // interval of the first step
+  unsigned int      maxSpeed;           // shortest step interval
+  unsigned long     accelRate;          // steps/s^2 (0 = LINEAR)
+  unsigned int      stepsPerMM;
+} Axis;
+
+// settings of the SMUFF.cfg axes, accelRate converted to steps/s^2
+static const Axis axes[] = {
+  { "Selector", ZStepper::SCURVE,  900,  100, 80000, 800 },
+  { "Revolver", ZStepper::SCURVE,  6000, 1000, 40000, 27 },
+  { "Feeder",   ZStepper::AVR446,  1000, 50,  82000, 410 },
+  { "Linear",   ZStepper::LINEAR,  1000, 100, 0,     410 },
+};
+
+static const char* modeNames[] = { "LINEAR", "TRAPEZOID", "SCURVE", "AVR446" };
+
+int main(int argc, char** argv) {
+  long steps = argc > 1 ? atol(argv[1]) : 20000;
+  if(steps < 32) {
+    fprintf(stderr, "usage: %s [steps (>= 32)]\n", argv[0]);
+    return 2;
+  }
+
+  printf("cycles per step, %ld steps per move\n", steps);
+  printf("%-10s %-10s %10s %10s %16s\n", "axis", "ramp", "legacy", "current", "current/legacy");
+  for(unsigned i=0; i < sizeof(axes)/sizeof(axes[0]); i++) {
+    const Axis& axis = axes[i];
+
+    LegacyStepper legacy(axis.acceleration, axis.maxSpeed, axis.stepsPerMM);
+    legacy.stepFunc = noStep;
+
+    ZStepper current(i, (char*)axis.name, -1, -1, -1, axis.acceleration, axis.maxSpeed);
+    current.stepFunc = noStep;
+    current.setStepsPerMM(axis.stepsPerMM);
+    current.setRampMode(axis.mode);
+    current.setAccelRate(axis.accelRate);
+    current.updateRampTable();
+
+    double legacyCycles = runMove(legacy, steps);
+    double currentCycles = runMove(current, steps);
+    printf("%-10s %-10s %10.1f %10.1f %16.2f\n", axis.name, modeNames[axis.accelRate == 0 ? ZStepper::LINEAR : axis.mode],
+           legacyCycles, currentCycles, currentCycles / legacyCycles);
+  }
+  return 0;
+}
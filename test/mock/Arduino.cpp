@@ -0,0 +1,462 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <ctype.h>
+#include "Arduino.h"
+
+// rough costs of the core functions on the target in CPU cycles
+#define CYCLES_DIGITAL_IO   60
+#define CYCLES_TIME         40
+#define CYCLES_SERIAL       30
+#define CYCLES_PER_BYTE     20
+#define SERIAL_RX_BUFFER    64
+
+unsigned long mockStringAllocations = 0;
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+HardwareSerial Serial3(3);
+
+/*
+ * Inputs are driven by the test (unconnected ones read high), so pull-ups
+ * make no difference.
+ */
+void pinMode(int pin, int mode) {
+}
+
+void digitalWrite(int pin, int level) {
+  VirtualAvr::spend(CYCLES_DIGITAL_IO);
+  VirtualAvr::setOutput(pin, level);
+}
+
+int digitalRead(int pin) {
+  VirtualAvr::spend(CYCLES_DIGITAL_IO);
+  return VirtualAvr::getInput(pin);
+}
+
+void analogWrite(int pin, int value) {
+  VirtualAvr::spend(CYCLES_DIGITAL_IO);
+}
+
+void tone(int pin, unsigned int frequency, unsigned long duration) {
+}
+
+void noTone(int pin) {
+}
+
+unsigned long millis() {
+  VirtualAvr::spend(CYCLES_TIME);
+  return (unsigned long)(VirtualAvr::now() / (F_CPU / 1000));
+}
+
+unsigned long micros() {
+  VirtualAvr::spend(CYCLES_TIME);
+  return (unsigned long)(VirtualAvr::now() / (F_CPU / 1000000));
+}
+
+/*
+ * Like the Arduino core, delay() keeps calling yield() while it waits.
+ */
+void delay(unsigned long ms) {
+  VirtualAvr::Cycles end = VirtualAvr::now() + ms * (F_CPU / 1000);
+  while(VirtualAvr::now() < end) {
+    yield();
+    VirtualAvr::Cycles step = end - VirtualAvr::now();
+    VirtualAvr::advance(step > 1000 ? 1000 : step);
+  }
+}
+
+void delayMicroseconds(unsigned int us) {
+  VirtualAvr::spend(us * (F_CPU / 1000000));
+}
+
+void __attribute__((weak)) yield() {
+}
+
+void attachInterrupt(int number, void (*isr)(), int mode) {
+  VirtualAvr::attachPinInterrupt(number, isr, mode);
+}
+
+void detachInterrupt(int number) {
+  VirtualAvr::attachPinInterrupt(number, NULL, 0);
+}
+
+size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t len = strlen(src);
+  if(size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = 0;
+  }
+  return len;
+}
+
+size_t strlcat(char* dst, const char* src, size_t size) {
+  size_t len = strnlen(dst, size);
+  if(len == size)
+    return len + strlen(src);
+  return len + strlcpy(dst + len, src, size - len);
+}
+
+/*
+ * String, allocating like the one of the Arduino core (one realloc()
+ * whenever the buffer has to grow).
+ */
+String::String(const char* cstr) {
+  if(cstr != NULL)
+    copy(cstr, strlen(cstr));
+}
+
+String::String(const String& str) {
+  *this = str;
+}
+
+String::String(const __FlashStringHelper* str) : String((const char*)str) {
+}
+
+String::String(char c) {
+  char buf[2] = { c, 0 };
+  *this = buf;
+}
+
+String::String(unsigned char value, unsigned char base) : String((unsigned long)value, base) {
+}
+
+String::String(int value, unsigned char base) : String((long)value, base) {
+}
+
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {
+}
+
+String::String(long value, unsigned char base) {
+  char buf[66];
+  if(base == 10)
+    snprintf(buf, sizeof(buf), "%ld", value);
+  else
+    snprintf(buf, sizeof(buf), base == 16 ? "%lx" : "%lo", value);
+  *this = buf;
+}
+
+String::String(unsigned long value, unsigned char base) {
+  char buf[66];
+  snprintf(buf, sizeof(buf), base == 16 ? "%lx" : base == 8 ? "%lo" : "%lu", value);
+  *this = buf;
+}
+
+String::String(float value, unsigned char decimals) : String((double)value, decimals) {
+}
+
+String::String(double value, unsigned char decimals) {
+  char buf[40];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+  *this = buf;
+}
+
+String::~String() {
+  free(_buffer);
+}
+
+bool String::changeBuffer(unsigned int size) {
+  char* buffer = (char*)realloc(_buffer, size + 1);
+  if(buffer == NULL)
+    return false;
+  mockStringAllocations++;
+  _buffer = buffer;
+  _capacity = size;
+  return true;
+}
+
+unsigned char String::reserve(unsigned int size) {
+  if(_buffer != NULL && _capacity >= size)
+    return 1;
+  if(!changeBuffer(size))
+    return 0;
+  if(_len == 0)
+    _buffer[0] = 0;
+  return 1;
+}
+
+void String::copy(const char* cstr, unsigned int length) {
+  if(!reserve(length))
+    return;
+  _len = length;
+  memmove(_buffer, cstr, length);
+  _buffer[length] = 0;
+}
+
+String& String::operator=(const String& rhs) {
+  if(this != &rhs)
+    copy(rhs.c_str(), rhs._len);
+  return *this;
+}
+
+String& String::operator=(const char* cstr) {
+  copy(cstr != NULL ? cstr : "", cstr != NULL ? strlen(cstr) : 0);
+  return *this;
+}
+
+unsigned char String::concat(const char* cstr) {
+  if(cstr == NULL)
+    return 0;
+  unsigned int length = strlen(cstr);
+  if(length == 0)
+    return 1;
+  if(!reserve(_len + length))
+    return 0;
+  memmove(_buffer + _len, cstr, length + 1);
+  _len += length;
+  return 1;
+}
+
+unsigned char String::concat(const String& str) {
+  if(&str == this) {
+    String tmp(str);
+    return concat(tmp.c_str());
+  }
+  return concat(str.c_str());
+}
+
+unsigned char String::concat(char c) {
+  char buf[2] = { c, 0 };
+  return concat(buf);
+}
+
+String operator+(const String& lhs, const String& rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+String operator+(const String& lhs, const char* rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+String operator+(const char* lhs, const String& rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+bool String::startsWith(const String& prefix) const {
+  return prefix._len <= _len && strncmp(c_str(), prefix.c_str(), prefix._len) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return suffix._len <= _len && strcmp(c_str() + _len - suffix._len, suffix.c_str()) == 0;
+}
+
+char& String::operator[](unsigned int index) {
+  static char dummy;
+  if(index >= _len) {
+    dummy = 0;
+    return dummy;
+  }
+  return _buffer[index];
+}
+
+void String::toCharArray(char* buf, unsigned int bufsize, unsigned int index) const {
+  if(bufsize == 0 || buf == NULL)
+    return;
+  if(index >= _len) {
+    buf[0] = 0;
+    return;
+  }
+  unsigned int n = bufsize - 1;
+  if(n > _len - index)
+    n = _len - index;
+  memcpy(buf, _buffer + index, n);
+  buf[n] = 0;
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+  if(fromIndex >= _len)
+    return -1;
+  const char* p = strchr(_buffer + fromIndex, ch);
+  return p != NULL ? p - _buffer : -1;
+}
+
+int String::indexOf(const String& str, unsigned int fromIndex) const {
+  if(fromIndex >= _len)
+    return -1;
+  const char* p = strstr(_buffer + fromIndex, str.c_str());
+  return p != NULL ? p - _buffer : -1;
+}
+
+int String::lastIndexOf(char ch) const {
+  if(_len == 0)
+    return -1;
+  const char* p = strrchr(_buffer, ch);
+  return p != NULL ? p - _buffer : -1;
+}
+
+int String::lastIndexOf(const String& str) const {
+  int found = -1;
+  for(int i = 0; (i = indexOf(str, i)) >= 0; i++)
+    found = i;
+  return found;
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+  if(beginIndex > endIndex) {
+    unsigned int tmp = endIndex;
+    endIndex = beginIndex;
+    beginIndex = tmp;
+  }
+  String result;
+  if(beginIndex >= _len)
+    return result;
+  if(endIndex > _len)
+    endIndex = _len;
+  result.copy(_buffer + beginIndex, endIndex - beginIndex);
+  return result;
+}
+
+void String::replace(char find, char replace) {
+  for(unsigned int i = 0; i < _len; i++) {
+    if(_buffer[i] == find)
+      _buffer[i] = replace;
+  }
+}
+
+void String::replace(const String& find, const String& replace) {
+  if(_len == 0 || find._len == 0)
+    return;
+  std::string result;
+  const char* p = _buffer;
+  const char* hit;
+  while((hit = strstr(p, find.c_str())) != NULL) {
+    result.append(p, hit - p);
+    result.append(replace.c_str());
+    p = hit + find._len;
+  }
+  if(p == _buffer)
+    return;
+  result.append(p);
+  copy(result.c_str(), result.length());
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if(index >= _len)
+    return;
+  if(count > _len - index)
+    count = _len - index;
+  memmove(_buffer + index, _buffer + index + count, _len - index - count + 1);
+  _len -= count;
+}
+
+void String::toLowerCase() {
+  for(unsigned int i = 0; i < _len; i++)
+    _buffer[i] = tolower(_buffer[i]);
+}
+
+void String::toUpperCase() {
+  for(unsigned int i = 0; i < _len; i++)
+    _buffer[i] = toupper(_buffer[i]);
+}
+
+void String::trim() {
+  if(_len == 0)
+    return;
+  unsigned int begin = 0;
+  while(begin < _len && isspace(_buffer[begin]))
+    begin++;
+  unsigned int end = _len;
+  while(end > begin && isspace(_buffer[end - 1]))
+    end--;
+  _len = end - begin;
+  memmove(_buffer, _buffer + begin, _len);
+  _buffer[_len] = 0;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while(size--)
+    n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(long value, int base) {
+  return print(String(value, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return print(String(value, (unsigned char)base));
+}
+
+size_t Print::print(double value, int digits) {
+  return print(String(value, (unsigned char)digits));
+}
+
+/*
+ * Moves the characters that have arrived by now into the receive buffer,
+ * dropping the ones that don't fit anymore.
+ */
+void HardwareSerial::receive() {
+  while(!_line.empty() && _line.front().when <= VirtualAvr::now()) {
+    if(_rx.size() < SERIAL_RX_BUFFER - 1)
+      _rx.push_back(_line.front().c);
+    else
+      _overruns++;
+    _line.pop_front();
+  }
+}
+
+int HardwareSerial::available() {
+  VirtualAvr::spend(CYCLES_SERIAL);
+  receive();
+  return _rx.size();
+}
+
+int HardwareSerial::peek() {
+  VirtualAvr::spend(CYCLES_SERIAL);
+  receive();
+  return _rx.empty() ? -1 : (unsigned char)_rx.front();
+}
+
+int HardwareSerial::read() {
+  VirtualAvr::spend(CYCLES_SERIAL);
+  receive();
+  if(_rx.empty())
+    return -1;
+  int c = (unsigned char)_rx.front();
+  _rx.pop_front();
+  return c;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  VirtualAvr::spend(CYCLES_PER_BYTE);
+  _output += (char)c;
+  if(_echo != NULL)
+    fputc(c, _echo);
+  return 1;
+}
+
+void HardwareSerial::inject(const char* data, VirtualAvr::Cycles when) {
+  // 10 bits per character (8N1)
+  VirtualAvr::Cycles charTime = F_CPU * 10 / _baudrate;
+  if(when == 0)
+    when = VirtualAvr::now();
+  if(!_line.empty() && _line.back().when + charTime > when)
+    when = _line.back().when + charTime;
+  for(const char* p = data; *p; p++, when += charTime)
+    _line.push_back({ when, *p });
+}
@@ -0,0 +1,241 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Mock of the Arduino core for building the firmware on the host.
+ *
+ * Time is taken from the VirtualAvr clock. Calls into the core from main
+ * context spend a few cycles on it, so busy loops polling millis() or the
+ * serial ports let the interrupts run. The serial ports take their input
+ * from inject() (paced at the baud rate and dropped like on the target if
+ * the 64 byte receive buffer is full) and collect their output.
+ */
+
+#ifndef _MOCK_ARDUINO_H
+#define _MOCK_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <cstdlib>
+#include <cmath>
+#include <deque>
+#include <string>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "VirtualAvr.h"
+
+#define F_CPU               16000000UL
+
+#define HIGH                1
+#define LOW                 0
+#define INPUT               0
+#define OUTPUT              1
+#define INPUT_PULLUP        2
+#define CHANGE              1
+#define FALLING             2
+#define RISING              3
+#define NOT_AN_INTERRUPT    -1
+#define DEC                 10
+#define HEX                 16
+
+typedef bool                boolean;
+typedef uint8_t             byte;
+typedef unsigned int        word;
+
+#define noInterrupts()      cli()
+#define interrupts()        sei()
+#define digitalPinToInterrupt(pin)    VirtualAvr::pinToInterrupt(pin)
+#define digitalPinToPort(pin)         (pin)
+#define digitalPinToBitMask(pin)      1
+#define portInputRegister(port)       VirtualAvr::getInputRegister(port)
+
+void            pinMode(int pin, int mode);
+void            digitalWrite(int pin, int level);
+int             digitalRead(int pin);
+void            analogWrite(int pin, int value);
+void            tone(int pin, unsigned int frequency, unsigned long duration = 0);
+void            noTone(int pin);
+unsigned long   millis();
+unsigned long   micros();
+void            delay(unsigned long ms);
+void            delayMicroseconds(unsigned int us);
+void            yield();
+void            attachInterrupt(int number, void (*isr)(), int mode);
+void            detachInterrupt(int number);
+size_t          strlcpy(char* dst, const char* src, size_t size);
+size_t          strlcat(char* dst, const char* src, size_t size);
+
+/*
+ * Heap allocations made by String, for comparing the parsers.
+ */
+extern unsigned long mockStringAllocations;
+
+class __FlashStringHelper;
+#define F(s)                ((const __FlashStringHelper*)(s))
+
+class String {
+public:
+  String(const char* cstr = "");
+  String(const String& str);
+  String(const __FlashStringHelper* str);
+  explicit String(char c);
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(float value, unsigned char decimals = 2);
+  explicit String(double value, unsigned char decimals = 2);
+  ~String();
+
+  String&       operator=(const String& rhs);
+  String&       operator=(const char* cstr);
+  unsigned char reserve(unsigned int size);
+  unsigned int  length() const { return _len; }
+  const char*   c_str() const { return _buffer != NULL ? _buffer : ""; }
+
+  unsigned char concat(const String& str);
+  unsigned char concat(const char* cstr);
+  unsigned char concat(char c);
+  unsigned char concat(int value) { return concat(String(value)); }
+  unsigned char concat(unsigned int value) { return concat(String(value)); }
+  unsigned char concat(long value) { return concat(String(value)); }
+  unsigned char concat(unsigned long value) { return concat(String(value)); }
+  unsigned char concat(float value) { return concat(String(value)); }
+  unsigned char concat(double value) { return concat(String(value)); }
+  template<typename T>
+  String&       operator+=(T rhs) { concat(rhs); return *this; }
+  String&       operator+=(const String& rhs) { concat(rhs); return *this; }
+
+  bool          equals(const String& str) const { return strcmp(c_str(), str.c_str()) == 0; }
+  bool          equals(const char* cstr) const { return strcmp(c_str(), cstr != NULL ? cstr : "") == 0; }
+  bool          operator==(const String& rhs) const { return equals(rhs); }
+  bool          operator==(const char* cstr) const { return equals(cstr); }
+  bool          operator!=(const String& rhs) const { return !equals(rhs); }
+  bool          operator!=(const char* cstr) const { return !equals(cstr); }
+  bool          startsWith(const String& prefix) const;
+  bool          endsWith(const String& suffix) const;
+
+  char          charAt(unsigned int index) const { return index < _len ? _buffer[index] : 0; }
+  char          operator[](unsigned int index) const { return charAt(index); }
+  char&         operator[](unsigned int index);
+  void          toCharArray(char* buf, unsigned int bufsize, unsigned int index = 0) const;
+
+  int           indexOf(char ch, unsigned int fromIndex = 0) const;
+  int           indexOf(const String& str, unsigned int fromIndex = 0) const;
+  int           lastIndexOf(char ch) const;
+  int           lastIndexOf(const String& str) const;
+  String        substring(unsigned int beginIndex) const { return substring(beginIndex, _len); }
+  String        substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+  void          replace(char find, char replace);
+  void          replace(const String& find, const String& replace);
+  void          remove(unsigned int index) { remove(index, (unsigned int)-1); }
+  void          remove(unsigned int index, unsigned int count);
+  void          toLowerCase();
+  void          toUpperCase();
+  void          trim();
+
+  long          toInt() const { return _buffer != NULL ? atol(_buffer) : 0; }
+  float         toFloat() const { return _buffer != NULL ? (float)atof(_buffer) : 0; }
+
+  friend String operator+(const String& lhs, const String& rhs);
+  friend String operator+(const String& lhs, const char* rhs);
+  friend String operator+(const char* lhs, const String& rhs);
+
+private:
+  bool          changeBuffer(unsigned int size);
+  void          copy(const char* cstr, unsigned int length);
+
+  char*         _buffer = NULL;
+  unsigned int  _capacity = 0;
+  unsigned int  _len = 0;
+};
+
+class Print {
+public:
+  virtual ~Print() { }
+  virtual size_t write(uint8_t c) = 0;
+  size_t write(const char* str) { return str != NULL ? write((const uint8_t*)str, strlen(str)) : 0; }
+  size_t write(const uint8_t* buffer, size_t size);
+
+  size_t print(const char* str) { return write(str); }
+  size_t print(const __FlashStringHelper* str) { return write((const char*)str); }
+  size_t print(const String& str) { return write(str.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+  template<typename T>
+  size_t println(T value) { size_t n = print(value); return n + println(); }
+  size_t println() { return write("\r\n"); }
+};
+
+class HardwareSerial : public Print {
+public:
+  HardwareSerial(int number) : _number(number) { }
+
+  void          begin(unsigned long baudrate) { _baudrate = baudrate; }
+  void          end() { }
+  int           available();
+  int           peek();
+  int           read();
+  void          flush() { }
+  size_t        write(uint8_t c);
+  using Print::write;
+  operator bool() { return true; }
+
+  // test side
+  void          inject(const char* data, VirtualAvr::Cycles when = 0);  // received at the baud rate, starting at 'when' (0 = now)
+  std::string&  output() { return _output; }
+  void          clearOutput() { _output.clear(); }
+  void          setEcho(FILE* stream) { _echo = stream; }             // also writes the output to 'stream'
+  unsigned long getOverruns() { return _overruns; }
+  bool          isIdle() { return _line.empty() && _rx.empty(); }
+
+private:
+  struct Arrival {
+    VirtualAvr::Cycles  when;
+    char                c;
+  };
+  void          receive();
+
+  int                   _number;
+  unsigned long         _baudrate = 9600;
+  std::deque<Arrival>   _line;              // characters on their way
+  std::deque<char>      _rx;                // receive buffer
+  std::string           _output;
+  FILE*                 _echo = NULL;
+  unsigned long         _overruns = 0;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif
@@ -0,0 +1,170 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include "ArduinoJson.h"
+
+JsonVariant JsonVariant::operator[](const char* key) const {
+  if(_node == NULL || _node->type != JsonNode::OBJECT)
+    return JsonVariant();
+  for(size_t i = 0; i < _node->keys.size(); i++) {
+    if(_node->keys[i] == key)
+      return JsonVariant(_node->children[i]);
+  }
+  return JsonVariant();
+}
+
+JsonVariant JsonVariant::operator[](int index) const {
+  if(_node == NULL || _node->type != JsonNode::ARRAY || index < 0 || index >= (int)_node->children.size())
+    return JsonVariant();
+  return JsonVariant(_node->children[index]);
+}
+
+long JsonVariant::asLong() const {
+  if(_node == NULL)
+    return 0;
+  switch(_node->type) {
+    case JsonNode::NUMBER:
+    case JsonNode::BOOLEAN:
+      return _node->integer;
+    case JsonNode::STRING:
+      return strtol(_node->text.c_str(), NULL, 0);
+    default:
+      return 0;
+  }
+}
+
+double JsonVariant::asDouble() const {
+  if(_node == NULL)
+    return 0;
+  switch(_node->type) {
+    case JsonNode::NUMBER:
+      return _node->number;
+    case JsonNode::BOOLEAN:
+      return _node->integer;
+    case JsonNode::STRING:
+      return strtod(_node->text.c_str(), NULL);
+    default:
+      return 0;
+  }
+}
+
+static void skipSpace(const char*& p) {
+  while(*p && isspace((unsigned char)*p))
+    p++;
+}
+
+bool DynamicJsonBuffer::parseString(const char*& p, std::string& s) {
+  if(*p != '"')
+    return false;
+  for(p++; *p && *p != '"'; p++) {
+    if(*p == '\\' && p[1])
+      p++;
+    s += *p;
+  }
+  if(*p != '"')
+    return false;
+  p++;
+  return true;
+}
+
+JsonNode* DynamicJsonBuffer::parseValue(const char*& p) {
+  skipSpace(p);
+  _nodes.push_back(JsonNode());
+  JsonNode* node = &_nodes.back();
+  if(*p == '{' || *p == '[') {
+    bool object = *p == '{';
+    char close = object ? '}' : ']';
+    node->type = object ? JsonNode::OBJECT : JsonNode::ARRAY;
+    p++;
+    skipSpace(p);
+    if(*p == close) {
+      p++;
+      return node;
+    }
+    while(true) {
+      skipSpace(p);
+      if(object) {
+        std::string key;
+        if(!parseString(p, key))
+          return NULL;
+        skipSpace(p);
+        if(*p++ != ':')
+          return NULL;
+        node->keys.push_back(key);
+      }
+      JsonNode* child = parseValue(p);
+      if(child == NULL)
+        return NULL;
+      node->children.push_back(child);
+      skipSpace(p);
+      if(*p == ',') {
+        p++;
+        continue;
+      }
+      if(*p++ != close)
+        return NULL;
+      return node;
+    }
+  }
+  if(*p == '"') {
+    node->type = JsonNode::STRING;
+    return parseString(p, node->text) ? node : NULL;
+  }
+  if(strncmp(p, "true", 4) == 0 || strncmp(p, "false", 5) == 0) {
+    node->type = JsonNode::BOOLEAN;
+    node->integer = *p == 't';
+    p += *p == 't' ? 4 : 5;
+    return node;
+  }
+  if(strncmp(p, "null", 4) == 0) {
+    p += 4;
+    return node;
+  }
+  char* end;
+  if(p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    node->integer = strtol(p, &end, 16);
+    node->number = node->integer;
+  }
+  else {
+    node->number = strtod(p, &end);
+    node->integer = (long)node->number;
+  }
+  if(end == p)
+    return NULL;
+  node->type = JsonNode::NUMBER;
+  p = end;
+  return node;
+}
+
+JsonObject& DynamicJsonBuffer::parseObject(const char* json) {
+  const char* p = json;
+  JsonNode* node = parseValue(p);
+  _root = JsonObject(node != NULL && node->type == JsonNode::OBJECT ? node : NULL);
+  return _root;
+}
+
+JsonObject& DynamicJsonBuffer::parseObject(File& file) {
+  std::string json;
+  int c;
+  while((c = file.read()) != -1)
+    json += (char)c;
+  return parseObject(json.c_str());
+}
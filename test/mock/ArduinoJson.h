@@ -0,0 +1,96 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _MOCK_ARDUINO_JSON_H
+#define _MOCK_ARDUINO_JSON_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include "SD.h"
+
+/*
+ * Just enough of ArduinoJson 5 for reading the configuration file.
+ * Missing members read as 0, false or NULL like in the real library.
+ */
+
+struct JsonNode {
+  enum Type { NONE, NUMBER, BOOLEAN, STRING, OBJECT, ARRAY } type = NONE;
+  double                    number = 0;
+  long                      integer = 0;
+  std::string               text;
+  std::vector<std::string>  keys;
+  std::vector<JsonNode*>    children;
+};
+
+class JsonVariant {
+public:
+  JsonVariant(const JsonNode* node = NULL) : _node(node) { }
+
+  bool          success() const { return _node != NULL; }
+  JsonVariant   operator[](const char* key) const;
+  JsonVariant   operator[](char* key) const { return (*this)[(const char*)key]; }
+  JsonVariant   operator[](const std::string& key) const { return (*this)[key.c_str()]; }
+  JsonVariant   operator[](int index) const;
+
+  operator bool() const { return asLong() != 0 || (_node != NULL && _node->type == JsonNode::NUMBER && _node->number != 0); }
+  operator char() const { return (char)asLong(); }
+  operator unsigned char() const { return (unsigned char)asLong(); }
+  operator short() const { return (short)asLong(); }
+  operator unsigned short() const { return (unsigned short)asLong(); }
+  operator int() const { return (int)asLong(); }
+  operator unsigned int() const { return (unsigned int)asLong(); }
+  operator long() const { return asLong(); }
+  operator unsigned long() const { return (unsigned long)asLong(); }
+  operator float() const { return (float)asDouble(); }
+  operator double() const { return asDouble(); }
+  operator const char*() const { return _node != NULL && _node->type == JsonNode::STRING ? _node->text.c_str() : NULL; }
+
+private:
+  long          asLong() const;
+  double        asDouble() const;
+
+  const JsonNode* _node;
+};
+
+class JsonObject : public JsonVariant {
+public:
+  JsonObject(const JsonNode* node = NULL) : JsonVariant(node) { }
+};
+
+class DynamicJsonBuffer {
+public:
+  JsonObject&   parseObject(File& file);
+  JsonObject&   parseObject(const char* json);
+
+private:
+  JsonNode*     parseValue(const char*& p);
+  bool          parseString(const char*& p, std::string& s);
+
+  std::deque<JsonNode>  _nodes;
+  JsonObject            _root;
+};
+
+template<size_t SIZE>
+class StaticJsonBuffer : public DynamicJsonBuffer {
+  char          _reserved[SIZE];                  // keeps sizeof() like on the target
+};
+
+#endif
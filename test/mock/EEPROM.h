@@ -0,0 +1,66 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _MOCK_EEPROM_H
+#define _MOCK_EEPROM_H
+
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Sizes of the integer types on the AVR, so the EEPROM layout (which uses
+ * sizeof(long) on the target) stays the same on the host.
+ */
+template<typename T> struct AvrType { typedef T type; };
+template<> struct AvrType<int> { typedef int16_t type; };
+template<> struct AvrType<unsigned int> { typedef uint16_t type; };
+template<> struct AvrType<long> { typedef int32_t type; };
+template<> struct AvrType<unsigned long> { typedef uint32_t type; };
+
+/*
+ * 4K of EEPROM like on the ATmega2560, erased (0xFF) on start.
+ */
+class EEPROMClass {
+public:
+  EEPROMClass() { memset(_data, 0xFF, sizeof(_data)); }
+
+  uint8_t read(int address) { return _data[address]; }
+  void    write(int address, uint8_t value) { _data[address] = value; }
+  void    update(int address, uint8_t value) { _data[address] = value; }
+  template<typename T>
+  T&      get(int address, T& value) {
+    typename AvrType<T>::type stored;
+    memcpy(&stored, _data + address, sizeof(stored));
+    return value = (T)stored;
+  }
+  template<typename T>
+  const T& put(int address, const T& value) {
+    typename AvrType<T>::type stored = (typename AvrType<T>::type)value;
+    memcpy(_data + address, &stored, sizeof(stored));
+    return value;
+  }
+  void    clear() { memset(_data, 0xFF, sizeof(_data)); }
+
+private:
+  uint8_t _data[4096];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
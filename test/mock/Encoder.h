@@ -0,0 +1,36 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _MOCK_ENCODER_H
+#define _MOCK_ENCODER_H
+
+/*
+ * Mock of the rotary encoder, the test turns it with write().
+ */
+class Encoder {
+public:
+  Encoder(int pin1, int pin2) { }
+  long  read() { return _position; }
+  void  write(long position) { _position = position; }
+
+private:
+  long  _position = 0;
+};
+
+#endif
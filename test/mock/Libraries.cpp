@@ -0,0 +1,67 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Instances of the mocked libraries.
+ */
+
+#include <string.h>
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "Wire.h"
+#include "MemoryFree.h"
+
+EEPROMClass EEPROM;
+TwoWire     Wire;
+
+int TwoWire::read() {
+  if(_rx.empty())
+    return -1;
+  int c = _rx.front();
+  _rx.pop_front();
+  return c;
+}
+
+void TwoWire::receive(const char* data) {
+  int n = strlen(data);
+  for(int i = 0; i < n; i++)
+    _rx.push_back((uint8_t)data[i]);
+  if(_handler == 0)
+    return;
+  bool enabled = VirtualAvr::interruptsEnabled();
+  cli();
+  _handler(n);
+  if(enabled)
+    sei();
+}
+
+int freeMemory() {
+  return 4096;
+}
+
+#include "U8g2lib.h"
+
+const u8g2_cb_t U8G2_R2 = 2;
+
+const uint8_t u8g2_font_6x12_t_symbols[] = { 0 };
+const uint8_t u8g2_font_7x14B_tf[] = { 0 };
+const uint8_t u8g2_font_6x10_mr[] = { 0 };
+const uint8_t u8g2_font_7x14_tf[] = { 0 };
+const uint8_t u8g2_font_helvR08_tf[] = { 0 };
+const uint8_t u8g2_font_open_iconic_check_2x_t[] = { 0 };
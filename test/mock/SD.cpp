@@ -0,0 +1,83 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <strings.h>
+#include "SD.h"
+
+SDClass SD;
+
+File::File(const std::string& name, const std::string* content, const std::vector<std::string>* entries) {
+  _name = name;
+  _content = content;
+  _entries = entries;
+  _open = true;
+}
+
+File File::openNextFile() {
+  if(_entries == NULL || _pos >= _entries->size())
+    return File();
+  const std::string& name = (*_entries)[_pos++];
+  return SD.open(name.c_str());
+}
+
+File SDClass::open(const char* path, int mode) {
+  if(!_inserted)
+    return File();
+  while(*path == '/')
+    path++;
+  if(*path == 0)
+    return File("/", NULL, &_names);
+  for(size_t i = 0; i < _names.size(); i++) {
+    if(strcasecmp(_names[i].c_str(), path) == 0)
+      return File(_names[i], &_contents[i]);
+  }
+  return File();
+}
+
+void SDClass::addFile(const char* name, const std::string& content) {
+  for(size_t i = 0; i < _names.size(); i++) {
+    if(strcasecmp(_names[i].c_str(), name) == 0) {
+      _contents[i] = content;
+      return;
+    }
+  }
+  _names.push_back(name);
+  _contents.push_back(content);
+  _inserted = true;
+}
+
+bool SDClass::addHostFile(const char* name, const char* hostPath) {
+  FILE* f = fopen(hostPath, "rb");
+  if(f == NULL)
+    return false;
+  std::string content;
+  char buf[512];
+  size_t n;
+  while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    content.append(buf, n);
+  fclose(f);
+  addFile(name, content);
+  return true;
+}
+
+void SDClass::clear() {
+  _names.clear();
+  _contents.clear();
+  _inserted = false;
+}
@@ -0,0 +1,75 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Mock of the SD library. The card holds the files added by the test,
+ * names are case insensitive like on FAT.
+ */
+
+#ifndef _MOCK_SD_H
+#define _MOCK_SD_H
+
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+#define FILE_READ   0
+
+class File {
+public:
+  File() { }
+  File(const std::string& name, const std::string* content, const std::vector<std::string>* entries = NULL);
+
+  operator bool() const { return _open; }
+  size_t        size() { return _content != NULL ? _content->size() : 0; }
+  int           available() { return _content != NULL ? (int)(_content->size() - _pos) : 0; }
+  int           read() { return available() > 0 ? (unsigned char)(*_content)[_pos++] : -1; }
+  void          close() { _open = false; }
+  bool          isDirectory() { return _entries != NULL; }
+  const char*   name() { return _name.c_str(); }
+  File          openNextFile();
+
+private:
+  std::string                     _name;
+  const std::string*              _content = NULL;
+  const std::vector<std::string>* _entries = NULL;
+  size_t                          _pos = 0;
+  bool                            _open = false;
+};
+
+class SDClass {
+public:
+  bool          begin(int csPin) { return _inserted; }
+  File          open(const char* path, int mode = FILE_READ);
+
+  // test side
+  void          setInserted(bool state) { _inserted = state; }
+  void          addFile(const char* name, const std::string& content);
+  bool          addHostFile(const char* name, const char* hostPath);   // copies a file of the host
+  void          clear();
+
+private:
+  bool                      _inserted = false;
+  std::vector<std::string>  _names;
+  std::vector<std::string>  _contents;
+};
+
+extern SDClass SD;
+
+#endif
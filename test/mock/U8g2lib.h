@@ -0,0 +1,88 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _MOCK_U8G2LIB_H
+#define _MOCK_U8G2LIB_H
+
+#include "Arduino.h"
+
+/*
+ * Mock of the display driver. Drawing does nothing, but sending the frame
+ * buffer takes its time. The dialogs and menus return the answers the test
+ * has set instead of waiting for the encoder.
+ */
+
+#define U8X8_PIN_NONE               255
+#define U8X8_MSG_GPIO_MENU_SELECT   80
+#define U8X8_MSG_GPIO_MENU_NEXT     81
+#define U8X8_MSG_GPIO_MENU_PREV     82
+#define U8X8_MSG_GPIO_MENU_HOME     83
+
+typedef struct u8x8_struct {
+  uint8_t debounce_state = HIGH;
+} u8x8_t;
+
+typedef int u8g2_cb_t;
+extern const u8g2_cb_t U8G2_R2;
+
+extern const uint8_t u8g2_font_6x12_t_symbols[];
+extern const uint8_t u8g2_font_7x14B_tf[];
+extern const uint8_t u8g2_font_6x10_mr[];
+extern const uint8_t u8g2_font_7x14_tf[];
+extern const uint8_t u8g2_font_helvR08_tf[];
+extern const uint8_t u8g2_font_open_iconic_check_2x_t[];
+
+class U8G2_ST7565_64128N_F_4W_HW_SPI : public Print {
+public:
+  U8G2_ST7565_64128N_F_4W_HW_SPI(const u8g2_cb_t& rotation, int cs, int dc, int reset) { }
+
+  bool      begin(int select = U8X8_PIN_NONE, int next = U8X8_PIN_NONE, int prev = U8X8_PIN_NONE, int home = U8X8_PIN_NONE) { return true; }
+  void      enableUTF8Print() { }
+  void      setContrast(uint8_t value) { }
+  void      setPowerSave(uint8_t state) { }
+  void      setFont(const uint8_t* font) { }
+  void      setFontMode(uint8_t mode) { }
+  void      setFontDirection(uint8_t dir) { }
+  void      setDrawColor(uint8_t color) { }
+  void      setBitmapMode(uint8_t mode) { }
+  void      setCursor(int x, int y) { }
+  void      drawXBMP(int x, int y, int w, int h, const uint8_t* bitmap) { }
+  int       drawStr(int x, int y, const char* s) { return getStrWidth(s); }
+  int       drawGlyph(int x, int y, uint16_t encoding) { return 6; }
+  void      drawFrame(int x, int y, int w, int h) { }
+  void      drawBox(int x, int y, int w, int h) { }
+  int       getStrWidth(const char* s) { return s != NULL ? 6 * strlen(s) : 0; }
+  int       getMaxCharHeight() { return 12; }
+  int       getDisplayWidth() { return 128; }
+  int       getDisplayHeight() { return 64; }
+  void      firstPage() { }
+  uint8_t   nextPage() { sendBuffer(); return 0; }
+  void      sendBuffer() { VirtualAvr::spend(20000); }   // 1K over SPI
+  void      clearDisplay() { sendBuffer(); }
+  uint8_t   userInterfaceSelectionList(const char* title, uint8_t start, const char* list) { return selectionAnswer; }
+  uint8_t   userInterfaceMessage(const char* title1, const char* title2, const char* title3, const char* buttons) { return messageAnswer; }
+  size_t    write(uint8_t c) { return 1; }
+  using Print::write;
+
+  // test side
+  uint8_t   selectionAnswer = 0;                      // 0 = menu aborted
+  uint8_t   messageAnswer = 1;                        // first button
+};
+
+#endif
@@ -0,0 +1,358 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "VirtualAvr.h"
+
+#define MOCK_TIMER_DEFINITIONS(n) \
+  volatile uint8_t  TCCR##n##A, TCCR##n##B, TIMSK##n; \
+  volatile uint16_t OCR##n##A, TCNT##n; \
+  MockFlagRegister  TIFR##n;
+
+MOCK_TIMER_DEFINITIONS(1)
+MOCK_TIMER_DEFINITIONS(3)
+MOCK_TIMER_DEFINITIONS(4)
+MOCK_TIMER_DEFINITIONS(5)
+
+MockPort PORTA(22);
+
+MockPort& MockPort::operator=(uint8_t value) {
+  uint8_t changed = _value ^ value;
+  _value = value;
+  for(int bit = 0; bit < 8; bit++) {
+    if(changed & _BV(bit))
+      VirtualAvr::setOutput(_firstPin + bit, (value & _BV(bit)) != 0);
+  }
+  return *this;
+}
+
+namespace VirtualAvr {
+
+struct Timer {
+  volatile uint8_t*  tccrb;
+  volatile uint8_t*  timsk;
+  volatile uint16_t* ocr;
+  volatile uint16_t* tcnt;
+  MockFlagRegister*  tifr;
+  void               (*vector)(void);
+  Cycles             residue;           // cycles not counted yet because of the prescaler
+  unsigned long      interrupts;
+};
+
+static Timer timers[] = {
+  { &TCCR1B, &TIMSK1, &OCR1A, &TCNT1, &TIFR1, TIMER1_COMPA_vect },
+  { &TCCR3B, &TIMSK3, &OCR3A, &TCNT3, &TIFR3, TIMER3_COMPA_vect },
+  { &TCCR4B, &TIMSK4, &OCR4A, &TCNT4, &TIFR4, TIMER4_COMPA_vect },
+  { &TCCR5B, &TIMSK5, &OCR5A, &TCNT5, &TIFR5, TIMER5_COMPA_vect },
+};
+static const int timerNumbers[] = { 1, 3, 4, 5 };
+#define NUM_TIMERS  (int)(sizeof(timers)/sizeof(timers[0]))
+
+// external interrupts of the ATmega2560 as numbered by attachInterrupt()
+static const int interruptPins[] = { 2, 3, 21, 20, 19, 18 };
+#define NUM_PIN_INTERRUPTS  (int)(sizeof(interruptPins)/sizeof(interruptPins[0]))
+
+static Cycles           clock = 0;
+static Cycles           timeLimit = 0;
+static bool             enabled = true;
+static bool             isrActive = false;
+static unsigned int     isrCycles = 0;
+static uint8_t          outputs[VIRTUAL_AVR_PINS];
+static volatile uint8_t inputs[VIRTUAL_AVR_PINS];
+static PinListener      pinListener = NULL;
+static void             (*pinIsr[NUM_PIN_INTERRUPTS])();
+static int              pinIsrMode[NUM_PIN_INTERRUPTS];
+static uint8_t          pinIsrPending = 0;
+
+static unsigned int prescaler(Timer& t) {
+  switch(*t.tccrb & 0x07) {
+    case 1: return 1;
+    case 2: return 8;
+    case 3: return 64;
+    case 4: return 256;
+    case 5: return 1024;
+  }
+  return 0;                             // stopped (external clock sources aren't used)
+}
+
+static bool isCtc(Timer& t) {
+  return (*t.tccrb & _BV(WGM42)) != 0;
+}
+
+/*
+ * Timer ticks until the counter matches the compare register next.
+ */
+static Cycles ticksToMatch(Timer& t) {
+  uint16_t tcnt = *t.tcnt;
+  uint16_t ocr = *t.ocr;
+  if(isCtc(t) && tcnt <= ocr)
+    return tcnt == ocr ? (Cycles)ocr + 1 : ocr - tcnt;
+  uint16_t ticks = ocr - tcnt;
+  return ticks == 0 ? 0x10000 : ticks;
+}
+
+static void countTicks(Timer& t, Cycles ticks) {
+  if(ticks == 0)
+    return;
+  if(ticks >= ticksToMatch(t)) {
+    *t.tcnt = *t.ocr;
+    t.tifr->raise(_BV(OCF4A));
+    return;
+  }
+  if(isCtc(t) && *t.tcnt == *t.ocr) {
+    *t.tcnt = 0;
+    ticks--;
+  }
+  *t.tcnt = (uint16_t)(*t.tcnt + ticks);
+}
+
+/*
+ * Lets the timers count for the given cycles, which must not span more
+ * than one compare match per timer.
+ */
+static void runTimers(Cycles cycles) {
+  for(int i = 0; i < NUM_TIMERS; i++) {
+    unsigned int scale = prescaler(timers[i]);
+    if(scale == 0)
+      continue;
+    Cycles total = timers[i].residue + cycles;
+    timers[i].residue = total % scale;
+    countTicks(timers[i], total / scale);
+  }
+  clock += cycles;
+  if(timeLimit != 0 && clock > timeLimit) {
+    fprintf(stderr, "VirtualAvr: time limit of %llu cycles exceeded\n", (unsigned long long)timeLimit);
+    exit(2);
+  }
+}
+
+static Cycles cyclesToNextMatch() {
+  Cycles next = ~(Cycles)0;
+  for(int i = 0; i < NUM_TIMERS; i++) {
+    unsigned int scale = prescaler(timers[i]);
+    if(scale == 0)
+      continue;
+    Cycles cycles = ticksToMatch(timers[i]) * scale - timers[i].residue;
+    if(cycles < next)
+      next = cycles;
+  }
+  return next;
+}
+
+static void runTimersFor(Cycles cycles) {
+  while(cycles > 0) {
+    Cycles step = cyclesToNextMatch();
+    if(step > cycles)
+      step = cycles;
+    runTimers(step);
+    cycles -= step;
+  }
+}
+
+static void callIsr(void (*vector)()) {
+  isrActive = true;
+  enabled = false;
+  vector();
+  runTimersFor(isrCycles);
+  isrActive = false;
+  enabled = true;
+}
+
+/*
+ * Runs the pending interrupts in the order of their vector priority.
+ */
+static void dispatch() {
+  while(enabled && !isrActive) {
+    bool called = false;
+    for(int i = 0; i < NUM_PIN_INTERRUPTS && !called; i++) {
+      if(pinIsrPending & _BV(i)) {
+        pinIsrPending &= ~_BV(i);
+        if(pinIsr[i] != NULL) {
+          callIsr(pinIsr[i]);
+          called = true;
+        }
+      }
+    }
+    for(int i = 0; i < NUM_TIMERS && !called; i++) {
+      Timer& t = timers[i];
+      if((*t.tifr & _BV(OCF4A)) && (*t.timsk & _BV(OCIE4A))) {
+        *t.tifr = _BV(OCF4A);           // cleared by hardware when the vector gets executed
+        t.interrupts++;
+        callIsr(t.vector);
+        called = true;
+      }
+    }
+    if(!called)
+      break;
+  }
+}
+
+void reset() {
+  for(int i = 0; i < NUM_TIMERS; i++) {
+    Timer& t = timers[i];
+    *t.tccrb = 0;
+    *t.timsk = 0;
+    *t.ocr = 0;
+    *t.tcnt = 0;
+    *t.tifr = 0xFF;
+    t.residue = 0;
+    t.interrupts = 0;
+  }
+  TCCR1A = TCCR3A = TCCR4A = TCCR5A = 0;
+  clock = 0;
+  timeLimit = 0;
+  enabled = true;
+  isrActive = false;
+  isrCycles = 0;
+  for(int i = 0; i < VIRTUAL_AVR_PINS; i++) {
+    outputs[i] = 0;
+    inputs[i] = 1;                      // floating inputs read high
+  }
+  for(int i = 0; i < NUM_PIN_INTERRUPTS; i++)
+    pinIsr[i] = NULL;
+  pinIsrPending = 0;
+}
+
+Cycles now() {
+  return clock;
+}
+
+void advance(Cycles cycles) {
+  advanceTo(clock + cycles);
+}
+
+void advanceTo(Cycles when) {
+  dispatch();
+  while(clock < when) {
+    Cycles step = cyclesToNextMatch();
+    if(step > when - clock)
+      step = when - clock;
+    runTimers(step);
+    dispatch();
+  }
+}
+
+void spend(unsigned int cycles) {
+  if(!isrActive)
+    advance(cycles);
+}
+
+bool inInterrupt() {
+  return isrActive;
+}
+
+bool interruptsEnabled() {
+  return enabled;
+}
+
+void setInterruptsEnabled(bool state) {
+  if(isrActive) {
+    enabled = state;                    // nested interrupts aren't modelled
+    return;
+  }
+  enabled = state;
+  dispatch();
+}
+
+void setIsrCycles(unsigned int cycles) {
+  isrCycles = cycles;
+}
+
+void setTimeLimit(Cycles cycles) {
+  timeLimit = cycles;
+}
+
+unsigned long getInterruptCount(int timer) {
+  for(int i = 0; i < NUM_TIMERS; i++) {
+    if(timerNumbers[i] == timer)
+      return timers[i].interrupts;
+  }
+  return 0;
+}
+
+void setOutput(int pin, int level) {
+  if(pin < 0 || pin >= VIRTUAL_AVR_PINS)
+    return;
+  level = level != 0;
+  if(outputs[pin] == level)
+    return;
+  outputs[pin] = level;
+  if(pinListener != NULL)
+    pinListener(pin, level, clock);
+}
+
+int getOutput(int pin) {
+  return pin >= 0 && pin < VIRTUAL_AVR_PINS ? outputs[pin] : 0;
+}
+
+void setInput(int pin, int level) {
+  if(pin < 0 || pin >= VIRTUAL_AVR_PINS)
+    return;
+  level = level != 0;
+  if(inputs[pin] == level)
+    return;
+  inputs[pin] = level;
+  for(int i = 0; i < NUM_PIN_INTERRUPTS; i++) {
+    if(interruptPins[i] != pin || pinIsr[i] == NULL)
+      continue;
+    if(pinIsrMode[i] == 1 /* CHANGE */ || (pinIsrMode[i] == 3 /* RISING */ && level) || (pinIsrMode[i] == 2 /* FALLING */ && !level))
+      pinIsrPending |= _BV(i);
+  }
+  dispatch();
+}
+
+int getInput(int pin) {
+  return pin >= 0 && pin < VIRTUAL_AVR_PINS ? inputs[pin] : 1;
+}
+
+volatile uint8_t* getInputRegister(int pin) {
+  return pin >= 0 && pin < VIRTUAL_AVR_PINS ? &inputs[pin] : NULL;
+}
+
+void setPinListener(PinListener listener) {
+  pinListener = listener;
+}
+
+void attachPinInterrupt(int number, void (*isr)(), int mode) {
+  if(number < 0 || number >= NUM_PIN_INTERRUPTS)
+    return;
+  pinIsr[number] = isr;
+  pinIsrMode[number] = mode;
+}
+
+int pinToInterrupt(int pin) {
+  for(int i = 0; i < NUM_PIN_INTERRUPTS; i++) {
+    if(interruptPins[i] == pin)
+      return i;
+  }
+  return -1;
+}
+
+}
+
+void cli() {
+  VirtualAvr::setInterruptsEnabled(false);
+}
+
+void sei() {
+  VirtualAvr::setInterruptsEnabled(true);
+}
@@ -0,0 +1,64 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Cycle based virtual clock of the simulated ATmega2560.
+ *
+ * Time only advances when the firmware (in main context) calls into the
+ * Arduino API or when the test advances it explicitly. While it advances,
+ * the 16 bit timers count with their prescalers and the compare match and
+ * pin change interrupts are dispatched, one at a time, with interrupts
+ * disabled, just like on the target. Code running in an interrupt takes
+ * no virtual time, unless setIsrCycles() says otherwise.
+ */
+
+#ifndef _VIRTUAL_AVR_H
+#define _VIRTUAL_AVR_H
+
+#include <stdint.h>
+
+#define VIRTUAL_AVR_PINS  70
+
+namespace VirtualAvr {
+  typedef uint64_t Cycles;
+  typedef void (*PinListener)(int pin, int level, Cycles when);
+
+  void    reset();                              // clock, timers, pins and interrupts back to power on state
+  Cycles  now();                                // CPU cycles since reset
+  void    advance(Cycles cycles);               // let the given time pass, dispatching interrupts
+  void    advanceTo(Cycles when);
+  void    spend(unsigned int cycles);           // cost of a main context operation (ignored within interrupts)
+  bool    inInterrupt();
+  bool    interruptsEnabled();
+  void    setInterruptsEnabled(bool state);
+  void    setIsrCycles(unsigned int cycles);    // virtual time each interrupt takes
+  void    setTimeLimit(Cycles cycles);          // aborts the program once the clock passes this (0 = none)
+  unsigned long getInterruptCount(int timer);   // compare match interrupts dispatched for TIMERn
+
+  void    setOutput(int pin, int level);        // called by digitalWrite() and the port registers
+  int     getOutput(int pin);
+  void    setInput(int pin, int level);         // drives an input pin, may raise a pin interrupt
+  int     getInput(int pin);
+  volatile uint8_t* getInputRegister(int pin);
+  void    setPinListener(PinListener listener); // notified about every output pin change
+  void    attachPinInterrupt(int number, void (*isr)(), int mode);
+  int     pinToInterrupt(int pin);          // -1 if the pin has no external interrupt
+}
+
+#endif
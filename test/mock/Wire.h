@@ -0,0 +1,48 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _MOCK_WIRE_H
+#define _MOCK_WIRE_H
+
+#include <deque>
+#include <stdint.h>
+
+/*
+ * Mock of the I2C slave side. receive() delivers a message from the bus
+ * master to the onReceive() handler, in interrupt context like on the target.
+ */
+class TwoWire {
+public:
+  void    begin(int address) { _address = address; }
+  void    onReceive(void (*handler)(int)) { _handler = handler; }
+  int     available() { return _rx.size(); }
+  int     read();
+
+  // test side
+  void    receive(const char* data);
+
+private:
+  int                 _address = -1;
+  void                (*_handler)(int) = 0;
+  std::deque<uint8_t> _rx;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _MOCK_AVR_INTERRUPT_H
+#define _MOCK_AVR_INTERRUPT_H
+
+/*
+ * Interrupt vectors become plain functions, VirtualAvr calls them
+ * whenever their interrupt is due.
+ */
+#define ISR(vector)   extern "C" void vector(void); void vector(void)
+
+extern "C" void TIMER1_COMPA_vect(void);
+extern "C" void TIMER3_COMPA_vect(void);
+extern "C" void TIMER4_COMPA_vect(void);
+extern "C" void TIMER5_COMPA_vect(void);
+
+void cli();
+void sei();
+
+#endif
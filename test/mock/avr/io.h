@@ -0,0 +1,92 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Mock of the ATmega2560 registers used by the firmware. The 16 bit timers
+ * 1, 3, 4 and 5 are modelled by VirtualAvr, which counts them on its
+ * virtual clock and raises their compare match interrupts.
+ */
+
+#ifndef _MOCK_AVR_IO_H
+#define _MOCK_AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef _BV
+#define _BV(bit)  (1 << (bit))
+#endif
+
+/*
+ * Interrupt flag register, flags get cleared by writing a one to them.
+ */
+class MockFlagRegister {
+public:
+  operator uint8_t() const { return _value; }
+  MockFlagRegister& operator=(uint8_t value) { _value &= ~value; return *this; }
+  MockFlagRegister& operator|=(uint8_t value) { _value &= ~(_value | value); return *this; }
+  void raise(uint8_t mask) { _value |= mask; }
+
+private:
+  volatile uint8_t _value = 0;
+};
+
+/*
+ * Output port, writes are passed on to the pins (digital pin firstPin + bit).
+ */
+class MockPort {
+public:
+  MockPort(int firstPin) : _firstPin(firstPin) { }
+  operator uint8_t() const { return _value; }
+  MockPort& operator=(uint8_t value);
+  // int like the promoted operand of a real register, so PORTA &= ~bit works
+  MockPort& operator|=(int value) { return *this = (uint8_t)(_value | value); }
+  MockPort& operator&=(int value) { return *this = (uint8_t)(_value & value); }
+
+private:
+  int              _firstPin;
+  volatile uint8_t _value = 0;
+};
+
+#define MOCK_TIMER_REGISTERS(n) \
+  extern volatile uint8_t  TCCR##n##A, TCCR##n##B, TIMSK##n; \
+  extern volatile uint16_t OCR##n##A, TCNT##n; \
+  extern MockFlagRegister  TIFR##n;
+
+MOCK_TIMER_REGISTERS(1)
+MOCK_TIMER_REGISTERS(3)
+MOCK_TIMER_REGISTERS(4)
+MOCK_TIMER_REGISTERS(5)
+
+extern MockPort PORTA;                  // digital pins 22..29
+
+#define CS10    0
+#define WGM12   3
+#define WGM32   3
+#define WGM42   3
+#define WGM52   3
+#define OCIE1A  1
+#define OCIE3A  1
+#define OCIE4A  1
+#define OCIE5A  1
+#define OCF1A   1
+#define OCF3A   1
+#define OCF4A   1
+#define OCF5A   1
+
+#endif
@@ -0,0 +1,49 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _MOCK_AVR_PGMSPACE_H
+#define _MOCK_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+/*
+ * There's only one address space on the host, flash reads are plain reads.
+ */
+#define PROGMEM
+#define PSTR(s)               (s)
+typedef const char*           PGM_P;
+
+#define pgm_read_byte(addr)   (*(const uint8_t*)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr)  (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr)    (*(void* const*)(addr))
+
+#define strcpy_P              strcpy
+#define strncpy_P             strncpy
+#define strcat_P              strcat
+#define strcmp_P              strcmp
+#define strncmp_P             strncmp
+#define strlen_P              strlen
+#define memcpy_P              memcpy
+#define sprintf_P             sprintf
+#define snprintf_P            snprintf
+
+#endif
@@ -0,0 +1,154 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Boots the firmware on the virtual clock, sends it G-code and writes
+ * a timestamp for each step of each axis (CSV: axis,cycle,position).
+ *
+ *   motion_sim [-o steps.csv] [-i isr_cycles] [-c Section.Key=value] [gcode ...]
+ *
+ * Without G-code it runs a tool change sequence. Fails if an axis has
+ * lost steps, i.e. the firmware's idea of a position doesn't match the
+ * machine anymore.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Firmware.h"
+#include "Machine.h"
+
+#define SECONDS(s)  ((VirtualAvr::Cycles)(s) * F_CPU)
+
+static const char* defaultProgram[] = { "G28", "T2", "T4", "T0", "G1 Y90", "G1 X30 Y180", NULL };
+static const char* axisNames[] = { "Selector", "Revolver", "Feeder" };
+
+/*
+ * Distance between the origins of the machine and the firmware.
+ */
+static long offset(int axis) {
+  return steppers[axis].wrapPosition(Machine::getPosition(axis) - steppers[axis].getStepPosition());
+}
+
+int main(int argc, char** argv) {
+  const char* csvFile = NULL;
+  unsigned int isrCycles = 400;
+  std::string config = Firmware::readConfig();
+  int first = 1;
+  for(; first < argc && argv[first][0] == '-'; first += 2) {
+    if(first + 1 >= argc) {
+      fprintf(stderr, "usage: %s [-o steps.csv] [-i isr_cycles] [-c Section.Key=value] [gcode ...]\n", argv[0]);
+      return 2;
+    }
+    if(strcmp(argv[first], "-o") == 0)
+      csvFile = argv[first + 1];
+    else if(strcmp(argv[first], "-i") == 0)
+      isrCycles = atoi(argv[first + 1]);
+    else if(strcmp(argv[first], "-c") == 0) {
+      std::string setting = argv[first + 1];
+      size_t dot = setting.find('.'), eq = setting.find('=');
+      if(eq == std::string::npos) {
+        fprintf(stderr, "motion_sim: bad setting %s\n", argv[first + 1]);
+        return 2;
+      }
+      std::string section = dot < eq ? setting.substr(0, dot) : "";
+      std::string key = dot < eq ? setting.substr(dot + 1, eq - dot - 1) : setting.substr(0, eq);
+      Firmware::setConfigValue(config, section.empty() ? NULL : section.c_str(), key.c_str(), setting.substr(eq + 1).c_str());
+    }
+  }
+
+  Firmware::boot(config);
+  VirtualAvr::setIsrCycles(isrCycles);
+  VirtualAvr::setTimeLimit(VirtualAvr::now() + SECONDS(600));
+  long offsets[NUM_STEPPERS];
+  for(int axis = 0; axis < NUM_STEPPERS; axis++)
+    offsets[axis] = offset(axis);
+  unsigned long stepperInterrupts = VirtualAvr::getInterruptCount(4);
+  unsigned long feederInterrupts = VirtualAvr::getInterruptCount(5);
+  Machine::clearSteps();
+  Machine::setRecording(true);
+  stepperTimer.setMeasurement(true);
+
+  int lines = 0;
+  if(first < argc) {
+    for(int i = first; i < argc; i++, lines++) {
+      Serial.inject(argv[i]);
+      Serial.inject("\n");
+    }
+  }
+  else {
+    for(const char** line = defaultProgram; *line != NULL; line++, lines++) {
+      Serial.inject(*line);
+      Serial.inject("\n");
+    }
+  }
+  VirtualAvr::Cycles start = VirtualAvr::now();
+  if(!Firmware::runUntilIdle(SECONDS(300))) {
+    fprintf(stderr, "motion_sim: firmware didn't get idle\n");
+    return 1;
+  }
+
+  const std::vector<Machine::Step>& steps = Machine::getSteps();
+  if(csvFile != NULL) {
+    FILE* csv = fopen(csvFile, "w");
+    if(csv == NULL) {
+      perror(csvFile);
+      return 2;
+    }
+    fprintf(csv, "axis,cycle,position\n");
+    for(size_t i = 0; i < steps.size(); i++)
+      fprintf(csv, "%s,%llu,%ld\n", axisNames[steps[i].axis], (unsigned long long)(steps[i].when - start), steps[i].position);
+    fclose(csv);
+  }
+
+  int errors = 0;
+  for(int axis = 0; axis < NUM_STEPPERS; axis++) {
+    VirtualAvr::Cycles last = 0, minInterval = 0;
+    unsigned long count = 0;
+    for(size_t i = 0; i < steps.size(); i++) {
+      if(steps[i].axis != axis)
+        continue;
+      if(count == 1 || (count > 1 && steps[i].when - last < minInterval))
+        minInterval = steps[i].when - last;
+      last = steps[i].when;
+      count++;
+    }
+    fprintf(stderr, "%-9s %8lu steps, shortest interval %llu cycles, position %ld (machine %ld)\n",
+            axisNames[axis], count, (unsigned long long)minInterval, steppers[axis].getStepPosition(), Machine::getPosition(axis));
+  }
+  // steps get batched when they come faster than MaxInterruptRate allows
+  fprintf(stderr, "%lu stepper timer (TIMER4) and %lu feeder timer (TIMER5) interrupts\n",
+          VirtualAvr::getInterruptCount(4) - stepperInterrupts, VirtualAvr::getInterruptCount(5) - feederInterrupts);
+  // the endstops release one step before the position they trigger at
+  for(int axis = 0; axis < NUM_STEPPERS; axis++) {
+    if(labs(offset(axis) - offsets[axis]) > 1) {
+      fprintf(stderr, "motion_sim: %s has lost %ld steps\n", axisNames[axis], offset(axis) - offsets[axis]);
+      errors++;
+    }
+  }
+  fprintf(stderr, "%d lines in %.3f s, %d ok, timer periods %lu, deviation %d/%d/%d ticks, %lu missed deadlines\n",
+          lines, (double)(VirtualAvr::now() - start) / F_CPU, Firmware::countResponses("ok\n"),
+          stepperTimer.getSamples(), stepperTimer.getDeviationMin(), stepperTimer.getDeviationAvg(), stepperTimer.getDeviationMax(),
+          stepperTimer.getMissedDeadlines());
+  if(Firmware::countResponses("ok\n") != lines) {
+    fprintf(stderr, "motion_sim: expected %d ok responses\n", lines);
+    errors++;
+  }
+  return errors > 0 ? 1 : 0;
+}
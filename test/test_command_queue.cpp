@@ -0,0 +1,77 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Sends commands while a tool change is running and checks that they get
+ * queued and executed afterwards, in the order they have been sent,
+ * instead of being rejected as "busy" or lost.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "Firmware.h"
+#include "Machine.h"
+#include "ZLineBuffer.h"
+
+#define MILLIS(ms)  ((VirtualAvr::Cycles)(ms) * (F_CPU / 1000))
+
+extern ZLineBuffer lineBuffer0;
+
+static int errors = 0;
+
+static void check(bool condition, const char* what) {
+  printf("%s: %s\n", condition ? "ok  " : "FAIL", what);
+  if(!condition)
+    errors++;
+}
+
+int main() {
+  Firmware::boot(Firmware::readConfig());
+  VirtualAvr::setTimeLimit(VirtualAvr::now() + MILLIS(60000));
+  Serial.clearOutput();
+
+  VirtualAvr::Cycles start = VirtualAvr::now();
+  Serial.inject("T1\n");
+  Serial.inject("M115\nM119\nM115\nM119\nM115\n", start + MILLIS(50));
+  bool idle = Firmware::runUntilIdle(MILLIS(30000));
+  check(idle, "firmware gets idle");
+
+  check(toolChangeTime > 50, "commands arrive during the tool change");
+  check(commandQueue.getMaxCount() > 0, "commands have been queued");
+  check(Firmware::countResponses("busy") == 0, "no busy response");
+  check(Firmware::countResponses("ok\n") == 6, "every command is acknowledged");
+  check(Serial.getOverruns() == 0 && lineBuffer0.getOverflows() == 0, "nothing lost while waiting");
+
+  // responses in the order the commands have been sent
+  static const char* expected[] = { "T1\n", "FIRMWARE_NAME", "M119", "FIRMWARE_NAME", "M119", "FIRMWARE_NAME", NULL };
+  const std::string& out = Serial.output();
+  size_t pos = 0;
+  bool ordered = true;
+  for(const char** marker = expected; *marker != NULL && ordered; marker++) {
+    pos = out.find(*marker, pos);
+    ordered = pos != std::string::npos;
+    if(ordered)
+      pos += strlen(*marker);
+  }
+  check(ordered, "responses in order");
+  check(out.find("FIRMWARE_NAME") > out.find("T1\n"), "queued commands run after the tool change");
+  if(errors > 0)
+    printf("output:\n%s\n", out.c_str());
+  return errors > 0 ? 1 : 0;
+}
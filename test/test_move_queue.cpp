@@ -0,0 +1,148 @@
+/**
+ * SMuFF Firmware - host test harness
+ * Copyright (C) 2019 Technik Gegg
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Pushes blocks through ZMoveQueue from a producer thread (the main loop)
+ * while a second thread consumes them the way the stepper ISR does, and
+ * checks that every block arrives once, complete and in order.
+ *
+ *   test_move_queue [blocks]
+ *
+ * Every 1000th block the consumer drops the queue (like an aborted move),
+ * that's the only time blocks may go missing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include "ZMoveQueue.h"
+
+#define CLEAR_EVERY   1000
+
+// the ISR runs to completion, the main loop never sees it half way
+#define ISR_BOUNDARY()  __asm__ __volatile__ ("" ::: "memory")
+
+static ZMoveQueue queue;
+static std::atomic<bool> producerDone(false);
+
+/*
+ * Block number 'seq', all fields derived from it so the consumer can
+ * tell a torn or stale block.
+ */
+static void makeBlock(unsigned long seq, MoveBlock* block) {
+  unsigned long group = seq >> 4;         // runs of blocks that may blend
+  memset(block, 0, sizeof(MoveBlock));
+  for(int i=0; i < NUM_STEPPERS; i++)
+    block->steps[i] = (long)(seq * (i + 3)) * ((group >> i) & 1 ? -1 : 1);
+  block->axisFlags = seq & 0xFF;
+  block->ignoreEndstopFlags = group & 0x0F;
+  block->axis = (group % (NUM_STEPPERS + 1)) - 1;
+  block->master = seq % NUM_STEPPERS;
+  block->intervalLimit = (seq * 7) & 0xFFFF;
+  block->rampSteps = group & 0x30 ? (long)(group & 0x3FF) + 1 : 0;
+  block->prepared = seq & 1;
+  block->waitFlags = (seq >> 3) & 0xFF;
+}
+
+static long sequenceOf(MoveBlock* block) {
+  return block->steps[0] / 3 * (block->steps[0] < 0 ? -1 : 1);
+}
+
+static bool isIntact(MoveBlock* block) {
+  MoveBlock expected;
+  makeBlock(sequenceOf(block), &expected);
+  return memcmp(block, &expected, sizeof(MoveBlock)) == 0;
+}
+
+static void producer(unsigned long blocks) {
+  MoveBlock block;
+  for(unsigned long seq = 1; seq <= blocks; seq++) {
+    makeBlock(seq, &block);
+    while(!queue.push(&block))
+      std::this_thread::yield();
+  }
+  producerDone = true;
+}
+
+int main(int argc, char** argv) {
+  unsigned long blocks = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+  unsigned long received = 0, dropped = 0, blended = 0, torn = 0, unordered = 0, lost = 0, badExit = 0;
+  long last = 0;
+  bool cleared = false;
+  byte maxCount = 0;
+
+  std::thread mainLoop(producer, blocks);
+  for(;;) {
+    ISR_BOUNDARY();
+    if(queue.isEmpty()) {
+      if(producerDone && queue.isEmpty())
+        break;
+      std::this_thread::yield();
+      continue;
+    }
+    byte count = queue.getCount();
+    if(count > maxCount)
+      maxCount = count;
+    long exitSteps = queue.getExitSteps();
+    MoveBlock* block = queue.peek();
+    // a block only ends above standstill if the next one continues its ramp
+    if(exitSteps < 0 || exitSteps > block->rampSteps)
+      badExit++;
+    if(exitSteps > 0)
+      blended++;
+    if(!isIntact(block))
+      torn++;
+    long seq = sequenceOf(block);
+    if(seq <= last)
+      unordered++;
+    else if(seq != last + 1) {
+      if(cleared)
+        dropped += seq - last - 1;
+      else
+        lost += seq - last - 1;
+    }
+    last = seq;
+    cleared = false;
+    received++;
+    ISR_BOUNDARY();
+    if(received % CLEAR_EVERY == 0) {
+      queue.clear();
+      cleared = true;
+    }
+    else
+      queue.pop();
+  }
+  mainLoop.join();
+
+  int errors = 0;
+  printf("%lu blocks, %lu received, %lu dropped, %lu blended, max. %u queued\n", blocks, received, dropped, blended, maxCount);
+  if(torn > 0 || unordered > 0 || badExit > 0) {
+    printf("FAIL: %lu torn, %lu out of order, %lu with invalid exit speed\n", torn, unordered, badExit);
+    errors++;
+  }
+  if(lost > 0 || (last != (long)blocks && !cleared)) {
+    printf("FAIL: %lu blocks lost, last block is %ld\n", lost, last);
+    errors++;
+  }
+  if(errors == 0)
+    printf("ok  : blocks arrive complete and in order\n");
+  return errors > 0 ? 1 : 0;
+}